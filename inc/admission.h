@@ -0,0 +1,26 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <sys/types.h>
+
+#define MAX_CLIENTS 1024                // clients with requests in flight at the same time
+#define DEFAULT_MAX_INFLIGHT 8          // requests in flight per client
+
+// Init the per-client counters allowing `max_inflight` requests per client
+void admission_init(int max_inflight);
+
+// Count a new request of the session `session` of `pid`: return 0 if
+// admitted, -1 if the client already reached its limit (or too many
+// clients are active)
+int admission_acquire(pid_t pid, unsigned int session);
+
+// A request of the session left the server
+void admission_release(pid_t pid, unsigned int session);
+
+// Current wall clock time in milliseconds, comparable among processes
+long long now_ms(void);
+
+// 1 if the absolute `deadline` (ms, 0 = none) is already passed
+int deadline_expired(long long deadline);
+
+#endif // ADMISSION_H
@@ -0,0 +1,32 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLAKE3_OUT_LEN 32
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_MAX_DEPTH 54     // enough chaining values for 2^64 bytes
+
+// State of a chunk of 1024 bytes being compressed
+typedef struct Blake3Chunk {
+    uint32_t cv[8];
+    uint64_t counter;
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint8_t block_len;
+    uint8_t blocks_compressed;
+} Blake3Chunk;
+
+// Portable BLAKE3 hasher (unkeyed hash mode, 32 bytes output)
+typedef struct Blake3 {
+    Blake3Chunk chunk;
+    uint32_t cv_stack[BLAKE3_MAX_DEPTH][8];  // chaining values of the complete subtrees
+    uint8_t cv_stack_len;
+} Blake3;
+
+void blake3_init(Blake3 *self);
+void blake3_update(Blake3 *self, const void *input, size_t len);
+void blake3_final(const Blake3 *self, uint8_t out[BLAKE3_OUT_LEN]);
+
+#endif // BLAKE3_H
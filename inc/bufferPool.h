@@ -0,0 +1,51 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// A fixed-size I/O buffer handed from the reader stage to the hash stage
+typedef struct Buffer {
+    unsigned char *data;
+    size_t len;            // valid bytes in data, 0 = end of file
+    struct Buffer *next;
+} Buffer;
+
+// Preallocated set of buffers: the reader blocks when all of them are in flight
+typedef struct BufferPool {
+    Buffer *buffers;       // backing array of descriptors
+    unsigned char *memory; // backing storage of the data
+    Buffer *free_list;
+    size_t buf_size;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t has_free;
+} BufferPool;
+
+// Bounded FIFO of filled buffers between one reader and one hasher
+typedef struct ChunkQueue {
+    Buffer *front;
+    Buffer *rear;
+    int len;
+    int depth;             // max buffers waiting to be hashed
+    int started;           // a hasher is consuming the queue
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} ChunkQueue;
+
+// Buffer pool
+void bufferpool_init(BufferPool *pool, int count, size_t buf_size);
+Buffer *bufferpool_get(BufferPool *pool);
+void bufferpool_put(BufferPool *pool, Buffer *buf);
+void bufferpool_destroy(BufferPool *pool);
+
+// Chunk queue
+void chunkqueue_init(ChunkQueue *q, int depth);
+void chunkqueue_push(ChunkQueue *q, Buffer *buf);
+Buffer *chunkqueue_pop(ChunkQueue *q);
+void chunkqueue_start(ChunkQueue *q);
+void chunkqueue_wait_started(ChunkQueue *q);
+void chunkqueue_destroy(ChunkQueue *q);
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,59 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+
+#include "chunker.h"
+#include "slab.h"
+#include "fileKey.h"
+
+#define CHUNK_FILE_TABLE_SIZE 1000
+#define CHUNK_INDEX_MIN_BUCKETS 4096    // the chunk table doubles as it fills
+#define CHUNKS_PER_SLAB 1024
+
+// Chunk list of the last content indexed of a file
+typedef struct ChunkFile {
+    char inode[FILE_INODE_KEY_SIZE];
+    char identity[FILE_IDENTITY_SIZE];
+    struct ChunkInfo *chunks;
+    int count;
+    struct ChunkFile *next;
+} ChunkFile;
+
+// Times a chunk digest was seen in the indexed files
+typedef struct ChunkEntry {
+    unsigned char digest[CHUNK_DIGEST_SIZE];
+    unsigned int occurrences;
+    struct ChunkEntry *next;
+} ChunkEntry;
+
+// Index of the chunks of every file chunked so far, kept next to the digest
+// cache: a file asked again is answered without reading it, and a chunk seen
+// in several files is reported as a duplicate. Only the last version of a
+// file is indexed, so rewriting or appending to it counts its chunks once.
+typedef struct {
+    ChunkFile *files[CHUNK_FILE_TABLE_SIZE];
+    ChunkEntry **chunks;
+    size_t numBuckets;
+    size_t numChunks;
+    SlabCache fileEntries;
+    SlabCache chunkEntries;
+} ChunkIndex;
+
+// Create a new empty index
+ChunkIndex *create_chunk_index();
+
+// Index the chunks of the content `identity` of the file `inode`. The chunks
+// of an older content of the file are not counted anymore, a content indexed
+// already is not counted again
+void chunk_index_put_file(ChunkIndex *ci, const char *inode, const char *identity, const ChunkList *list);
+
+// Copy the chunk list of the content `identity` of the file `inode` into
+// `list`, return 0 if found, -1 otherwise
+int chunk_index_get_file(ChunkIndex *ci, const char *inode, const char *identity, ChunkList *list);
+
+// Times a chunk digest appears in the indexed files, 0 if never seen
+unsigned int chunk_index_occurrences(ChunkIndex *ci, const unsigned char *digest);
+
+// Free the entire index
+void free_chunk_index(ChunkIndex *ci);
+
+#endif // CHUNK_INDEX_H
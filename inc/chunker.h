@@ -0,0 +1,46 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <openssl/sha.h>
+
+#include "requestResponse.h"
+
+// FastCDC sizes: no cut before MIN, the harder mask until NORMAL makes the
+// chunks cluster around it, a cut is forced at MAX
+#define CDC_MIN_SIZE    (2 * 1024)
+#define CDC_NORMAL_SIZE (8 * 1024)
+#define CDC_MAX_SIZE    (64 * 1024)
+
+// Growable list of the chunks of a file
+typedef struct ChunkList {
+    struct ChunkInfo *chunks;
+    int count;
+    int capacity;
+} ChunkList;
+
+// Splits a stream into content-defined chunks with a gear rolling hash and
+// computes the SHA-256 of each one. Boundaries depend only on the content,
+// so an insertion shifts the following chunks without changing them.
+typedef struct Chunker {
+    uint64_t hash;              // gear hash of the window ending at the last byte seen
+    size_t length;              // bytes of the current chunk seen so far
+    long long offset;           // first byte of the current chunk
+    SHA256_CTX sha256;          // digest of the current chunk
+} Chunker;
+
+// Start chunking a stream from its first byte
+void chunker_init(Chunker *c);
+
+// Feed the next `n` bytes of the stream, the chunks completed are appended to `list`
+void chunker_update(Chunker *c, const unsigned char *data, size_t n, ChunkList *list);
+
+// End of the stream: append the last chunk, if not empty
+void chunker_final(Chunker *c, ChunkList *list);
+
+void chunklist_init(ChunkList *list);
+void chunklist_append(ChunkList *list, const struct ChunkInfo *chunk);
+void chunklist_free(ChunkList *list);
+
+#endif // CHUNKER_H
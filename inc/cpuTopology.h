@@ -0,0 +1,31 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#define MAX_NUMA_NODES 16
+#define MAX_CPUS 1024
+
+// Read the NUMA layout from sysfs. Without NUMA information every online CPU
+// belongs to a single node 0. Nodes are numbered densely from 0.
+void topology_init(void);
+
+// Number of NUMA nodes with at least one online CPU
+int topology_num_nodes(void);
+
+// Copy the CPUs of `node` into `cpus` (at most `max`), return how many
+int topology_node_cpus(int node, int *cpus, int max);
+
+// Node of a CPU, 0 if unknown
+int topology_node_of_cpu(int cpu);
+
+// Node of the CPU the calling thread is running on
+int topology_current_node(void);
+
+// Parse a list like "0-3,8,10-11" into `cpus` (at most `max`), return how many
+// or -1 if the list is malformed
+int parse_cpu_list(const char *list, int *cpus, int max);
+
+// Restrict the calling thread to `cpus`, or give it back the affinity the
+// process started with if n == 0. Return 0 on success
+int topology_bind_current_thread(const int *cpus, int n);
+
+#endif // CPU_TOPOLOGY_H
@@ -0,0 +1,39 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "requestResponse.h"
+#include "blake3.h"
+
+// Computes the digests of several algorithms reading the data once
+typedef struct DigestCtx {
+    unsigned int algorithms;            // DIGEST_BIT mask being computed
+    EVP_MD_CTX *evp[DIGEST_COUNT];      // OpenSSL algorithms, owned by the thread
+    SHA256_CTX sha256;                  // plain struct: its midstate can be saved
+    Blake3 blake3;
+} DigestCtx;
+
+// Start the digests of `algorithms` (0 = SHA-256). A thread can compute one
+// DigestCtx at a time: the OpenSSL contexts are reused among its requests.
+// Return 0 on success, -1 on error
+int digest_init(DigestCtx *ctx, unsigned int algorithms);
+void digest_update(DigestCtx *ctx, const void *data, size_t len);
+
+// Continue SHA-256 from a midstate saved by digest_sha256_midstate instead
+// of starting from the first byte
+void digest_resume_sha256(DigestCtx *ctx, const SHA256_CTX *midstate);
+
+// Save the SHA-256 state of the data given so far, whose length must be a
+// multiple of SHA256_CBLOCK
+void digest_sha256_midstate(const DigestCtx *ctx, SHA256_CTX *midstate);
+
+// Write the hex digest of each algorithm in hex[algo]
+void digest_final(DigestCtx *ctx, char hex[DIGEST_COUNT][DIGEST_HEX_SIZE]);
+
+// Name of an algorithm, e.g. "sha256"
+const char *digest_name(int algo);
+
+#endif // DIGEST_H
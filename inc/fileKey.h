@@ -0,0 +1,8 @@
+#ifndef FILE_KEY_H
+#define FILE_KEY_H
+
+// Keys of a file shared by the server caches, '\0' included
+#define FILE_INODE_KEY_SIZE 48      // "maj.min:inode", the file whatever its content
+#define FILE_IDENTITY_SIZE 96       // "maj.min:inode:size:mtime", a content of the file
+
+#endif // FILE_KEY_H
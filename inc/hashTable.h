@@ -5,24 +5,30 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "slab.h"
+
 #define TABLE_SIZE 1000
+#define MAX_KEY_SIZE 256        // longest key stored, '\0' included
+#define MAX_VALUE_SIZE 129      // longest value stored, '\0' included
+#define ENTRIES_PER_SLAB 256
 
 // Struct for a hash table entry (key-value pair)
 typedef struct Entry { // in our example is the hash of an already calculated filename
-    char *key;          // filename
-    char *value;        // hashcode
+    char key[MAX_KEY_SIZE];     // filename
+    char value[MAX_VALUE_SIZE]; // hashcode
     struct Entry *next;
 } Entry;
 
 // Struct for the hash table
 typedef struct {
     Entry *table[TABLE_SIZE];
+    SlabCache entries;  // entries are recycled instead of malloc/free
 } HashTable;
 
 // Create a new hash table
 HashTable *create_hash_table();
 
-// Insert a key-value pair into the hash table
+// Insert a key-value pair into the hash table, keys or values too long are not stored
 void hash_table_insert(HashTable *ht, const char *key, const char *value);
 
 // Get the value associated with a key
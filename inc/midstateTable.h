@@ -0,0 +1,47 @@
+#ifndef MIDSTATE_TABLE_H
+#define MIDSTATE_TABLE_H
+
+#include <openssl/sha.h>
+
+#include "slab.h"
+#include "fileKey.h"
+
+#define MIDSTATE_TABLE_SIZE 1000
+#define MIDSTATE_TAIL_SIZE 4096         // bytes covered by the tail fingerprint
+#define MIDSTATES_PER_SLAB 64
+
+// SHA-256 state of a file after its first `length` bytes. If the file only
+// grew, hashing can resume from here reading just the new bytes.
+typedef struct Midstate {
+    char key[FILE_INODE_KEY_SIZE];              // inode key of the file
+    SHA256_CTX ctx;
+    long long length;                           // multiple of SHA256_CBLOCK
+    unsigned char tail[SHA256_DIGEST_LENGTH];   // fingerprint of the bytes before length
+    struct Midstate *next;
+} Midstate;
+
+typedef struct {
+    Midstate *table[MIDSTATE_TABLE_SIZE];
+    SlabCache entries;
+} MidstateTable;
+
+// Create a new midstate table
+MidstateTable *create_midstate_table();
+
+// Copy the midstate of `key` into `out`, return 0 if found, -1 otherwise
+int midstate_table_get(MidstateTable *mt, const char *key, Midstate *out);
+
+// Insert or replace the midstate of m->key
+void midstate_table_put(MidstateTable *mt, const Midstate *m);
+
+// Remove the midstate of a file
+void midstate_table_remove(MidstateTable *mt, const char *key);
+
+// Free the entire table
+void free_midstate_table(MidstateTable *mt);
+
+// Fingerprint of the (up to) MIDSTATE_TAIL_SIZE bytes of fd before offset `end`,
+// return 0 on success, -1 if they can not be read
+int midstate_fingerprint(int fd, long long end, unsigned char out[SHA256_DIGEST_LENGTH]);
+
+#endif // MIDSTATE_TABLE_H
@@ -4,14 +4,61 @@
 
 #define MAX_FILENAME_SIZE 256  /* Massima dimensione del nome del file */
 
+#define SERVER_FIFO "/tmp/fifoServer"
+#define CLIENT_FIFO_FORMAT "/tmp/fifoClient%d.%u"   /* PID and session of the client */
+#define CLIENT_FIFO_SIZE 64
+
+/* Digest algorithms, a request selects them with a mask of DIGEST_BIT() */
+#define DIGEST_SHA256      0
+#define DIGEST_SHA512_256  1
+#define DIGEST_SHA1        2
+#define DIGEST_BLAKE3      3
+#define DIGEST_COUNT       4
+#define DIGEST_BIT(algo)   (1u << (algo))
+#define DIGEST_ALL         (DIGEST_BIT(DIGEST_COUNT) - 1)
+#define DIGEST_HEX_SIZE    65   /* longest digest in hex format, '\0' included */
+#define DIGEST_NAMES       { "sha256", "sha512-256", "sha1", "blake3" }
+
+/* Options of a request, combined with the DIGEST_BIT mask */
+#define REQUEST_CHUNKS     (1u << 16)   /* SHA-256 of content-defined chunks too */
+#define REQUEST_APPEND_ONLY (1u << 17)  /* the file is only appended to: the   */
+                                        /* SHA-256 may resume from a midstate  */
+
 struct Request {                        /* Request (client --> server)  */
     pid_t cPid;                         /* PID of client                */
+    unsigned int sessionId;             /* client FIFO of the PID       */
+    unsigned int requestId;             /* echoed back in the response  */
     char fileName[MAX_FILENAME_SIZE];   /* Nome del file                */
     long long fileSize;                 /* per l'ordinamento della coda */
+    long long deadline;                 /* ms since epoch, 0 = no limit */
+    unsigned int algorithms;            /* DIGEST_BIT mask | REQUEST_* */
+};
+
+/* Status of a response */
+#define RESPONSE_OK        0            /* hashCode holds the digest    */
+#define RESPONSE_NOT_FOUND 1            /* the file can not be read     */
+#define RESPONSE_BUSY      2            /* server overloaded, retry     */
+
+/* Content-defined chunk of a file */
+#define CHUNKS_PER_RESPONSE 32          /* a response stays below PIPE_BUF */
+#define CHUNK_DIGEST_SIZE  32           /* binary SHA-256 of the chunk  */
+
+struct ChunkInfo {
+    long long offset;                   /* first byte in the file       */
+    unsigned int length;
+    unsigned int occurrences;           /* times indexed by the server, > 1 = duplicate */
+    unsigned char digest[CHUNK_DIGEST_SIZE];
 };
 
-struct Response {         /* Response (server --> client) */
-    char hashCode[256];   /* file HASH using SHA-256      */
+struct Response {                            /* Response (server --> client)   */
+    unsigned int requestId;                 /* id of the request answered     */
+    int status;                             /* RESPONSE_*                     */
+    unsigned int algorithms;                /* digests filled in `digests`    */
+    char hashCode[256];                     /* first digest or error message  */
+    char digests[DIGEST_COUNT][DIGEST_HEX_SIZE]; /* one per algorithm, in hex */
+    int more;                               /* more responses follow (chunks) */
+    int numChunks;                          /* chunks filled in `chunks`      */
+    struct ChunkInfo chunks[CHUNKS_PER_RESPONSE];
 };
 
 #endif
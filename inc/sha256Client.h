@@ -0,0 +1,72 @@
+#ifndef SHA256_CLIENT_H
+#define SHA256_CLIENT_H
+
+#include "requestResponse.h"
+
+#define SHA256_TIMEOUT (-1)         // status of a request whose deadline passed
+#define SHA256_DEFAULT_WINDOW 8     // requests in flight at the server per session
+#define SHA256_DEFAULT_TIMEOUT_MS 10000
+
+// A session owns a client FIFO and the open server FIFO: it is reused by
+// all its requests, and any number of them can be outstanding. Requests
+// beyond the window are queued in the session and sent as responses arrive.
+// A session can be used by several threads.
+typedef struct Sha256Session Sha256Session;
+
+// Outcome of a request
+typedef struct Sha256Result {
+    unsigned int requestId;
+    int status;                                 // RESPONSE_* or SHA256_TIMEOUT
+    char fileName[MAX_FILENAME_SIZE];
+    unsigned int algorithms;                    // digests filled in `digests`
+    char message[256];                          // first digest or error message
+    char digests[DIGEST_COUNT][DIGEST_HEX_SIZE];
+    int more;                                   // partial result, the request is not completed
+    int numChunks;                              // chunks of this result (REQUEST_CHUNKS)
+    struct ChunkInfo chunks[CHUNKS_PER_RESPONSE];
+} Sha256Result;
+
+// Called by sha256_poll when a request completes, the result is valid
+// only during the call. With REQUEST_CHUNKS the chunks arrive in batches:
+// the callback is called once per batch, the last call has `more` == 0
+typedef void (*Sha256Callback)(const Sha256Result *result, void *userData);
+
+// Open a session with the server, NULL if the server is not running
+Sha256Session *sha256_session_open(void);
+
+// Close the session: the outstanding requests are dropped without callbacks
+void sha256_session_close(Sha256Session *session);
+
+// Max requests sent to the server and not yet answered (>= 1)
+void sha256_session_set_window(Sha256Session *session, int window);
+
+// Submit a request of the digests `algorithms` (DIGEST_BIT mask, 0 = SHA-256,
+// | REQUEST_CHUNKS for the chunks too) of `path`. With | REQUEST_APPEND_ONLY,
+// only if `path` is never modified but by appending, the server may hash just
+// the bytes added since it last hashed it. The request expires `timeoutMs`
+// after it is sent to the server (<= 0 = SHA256_DEFAULT_TIMEOUT_MS): the time
+// queued behind the window does not count. A request the server rejects as
+// busy is sent again until it expires.
+// `callback` is called by sha256_poll. Return the id of the request, 0 on error
+unsigned int sha256_submit(Sha256Session *session, const char *path, unsigned int algorithms,
+                           int timeoutMs, Sha256Callback callback, void *userData);
+
+// Wait up to `timeoutMs` (-1 = until one completes or a batch of chunks
+// arrives) for responses and call the callbacks. Return how many requests
+// completed, -1 on error
+int sha256_poll(Sha256Session *session, int timeoutMs);
+
+// Number of requests not completed yet
+int sha256_pending(Sha256Session *session);
+
+// File descriptor readable when responses arrive, to add the session to an
+// event loop that calls sha256_poll(session, 0)
+int sha256_session_fd(Sha256Session *session);
+
+// Submit a request and wait for it, meanwhile the callbacks of the other
+// requests of the session are called. Return 0 and fill `result`, -1 on error.
+// Only the last batch of chunks is kept in `result`
+int sha256_hash_file(Sha256Session *session, const char *path, unsigned int algorithms,
+                     int timeoutMs, Sha256Result *result);
+
+#endif // SHA256_CLIENT_H
@@ -0,0 +1,30 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define MAX_SLAB_CACHES 16      // caches that get per-thread free lists
+#define SLAB_BATCH 32           // objects moved between a thread and the cache at once
+
+// Allocator of fixed-size objects carved from big slabs. Freed objects are
+// kept in free lists and reused, so once warm it never calls malloc/free.
+// Each thread keeps a small private free list: the shared one (and its
+// mutex) is touched only once every SLAB_BATCH allocations or frees.
+typedef struct SlabCache {
+    int id;                     // index of the per-thread free list, -1 if none
+    size_t obj_size;
+    int objs_per_slab;
+    void *free_list;            // shared free list
+    void *slabs;                // chain of the allocated slabs
+    pthread_mutex_t mutex;
+} SlabCache;
+
+void slab_init(SlabCache *cache, size_t obj_size, int objs_per_slab);
+void *slab_alloc(SlabCache *cache);
+void slab_free(SlabCache *cache, void *obj);
+
+// Release all the slabs: every object of the cache becomes invalid
+void slab_destroy(SlabCache *cache);
+
+#endif // SLAB_H
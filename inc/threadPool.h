@@ -24,12 +24,15 @@ typedef struct jobqueue {
     job* rear;
     pthread_mutex_t rwmutex;
     bsem* has_jobs;
+    pthread_cond_t has_space;   // signaled when a job leaves a bounded queue
     int len;
+    int capacity;               // max queued jobs, 0 = unbounded
 } jobqueue;
 
 // Struttura per un singolo thread del pool
 typedef struct thread {
     int id;
+    int cpu;             // CPU the thread is pinned to, -1 if not pinned
     pthread_t pthread;
     struct ThreadPool* thpool_p;
 } thread;
@@ -47,7 +50,12 @@ typedef struct ThreadPool {
 
 // Prototipi delle funzioni
 void threadpool_init(ThreadPool *pool, int num_threads);
+void threadpool_init_bounded(ThreadPool *pool, int num_threads, int capacity);
+void threadpool_init_pinned(ThreadPool *pool, int num_threads, int capacity, const int *cpus, int num_cpus);
 void threadpool_add_job(ThreadPool *pool, void (*function)(void*), void* arg);
+void threadpool_add_job_priority(ThreadPool *pool, void (*function)(void*), void* arg, long long priority);
+int threadpool_try_add_job_priority(ThreadPool *pool, void (*function)(void*), void* arg, long long priority);
+int threadpool_try_add_jobs(ThreadPool *pool, void (*function)(void*), void** args, const long long* priorities, int n);
 void threadpool_wait(ThreadPool *pool);
 void threadpool_destroy(ThreadPool *pool);
 
@@ -55,5 +63,6 @@ void threadpool_destroy(ThreadPool *pool);
 void bsem_init(bsem *b, int v);
 void bsem_wait(bsem *b);
 void bsem_post(bsem *b);
+void bsem_post_n(bsem *b, int n);
 
 #endif // THREADPOOL_H
@@ -0,0 +1,83 @@
+#include <time.h>
+#include <pthread.h>
+
+#include "../inc/admission.h"
+
+// Requests in flight of a client, the slot is free when inflight == 0
+typedef struct ClientSlot {
+    pid_t pid;
+    unsigned int session;
+    int inflight;
+} ClientSlot;
+
+// Open addressing table: a slot with pid == 0 ends a probe sequence
+static ClientSlot clients[MAX_CLIENTS];
+static int maxInflight = DEFAULT_MAX_INFLIGHT;
+static pthread_mutex_t clientsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void admission_init(int max_inflight) {
+    pthread_mutex_lock(&clientsMutex);
+    maxInflight = max_inflight < 1 ? 1 : max_inflight;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].pid = 0;
+        clients[i].session = 0;
+        clients[i].inflight = 0;
+    }
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+// Find the slot of a client, or a free slot to reuse if `create` is set
+static ClientSlot *find_slot(pid_t pid, unsigned int session, int create) {
+    ClientSlot *reusable = NULL;
+    unsigned int start = ((unsigned int)pid * 31 + session) % MAX_CLIENTS;
+
+    for (unsigned int i = 0; i < MAX_CLIENTS; i++) {
+        ClientSlot *slot = &clients[(start + i) % MAX_CLIENTS];
+        if (slot->pid == pid && slot->session == session)
+            return slot;
+        if (slot->inflight == 0 && reusable == NULL)
+            reusable = slot;
+        if (slot->pid == 0)
+            break; // end of the probe sequence: pid is not in the table
+    }
+
+    if (create && reusable != NULL) {
+        reusable->pid = pid;
+        reusable->session = session;
+        reusable->inflight = 0;
+        return reusable;
+    }
+    return NULL;
+}
+
+int admission_acquire(pid_t pid, unsigned int session) {
+    int admitted = -1;
+
+    pthread_mutex_lock(&clientsMutex);
+    ClientSlot *slot = find_slot(pid, session, 1);
+    if (slot != NULL && slot->inflight < maxInflight) {
+        slot->inflight++;
+        admitted = 0;
+    }
+    pthread_mutex_unlock(&clientsMutex);
+
+    return admitted;
+}
+
+void admission_release(pid_t pid, unsigned int session) {
+    pthread_mutex_lock(&clientsMutex);
+    ClientSlot *slot = find_slot(pid, session, 0);
+    if (slot != NULL && slot->inflight > 0)
+        slot->inflight--;
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int deadline_expired(long long deadline) {
+    return deadline != 0 && now_ms() >= deadline;
+}
@@ -0,0 +1,195 @@
+#include <string.h>
+
+#include "../inc/blake3.h"
+
+// Portable implementation following the BLAKE3 specification: the input is
+// split in chunks of 1024 bytes, each chunk is compressed block by block and
+// the chaining values of the chunks are merged in a binary tree.
+
+#define CHUNK_START (1 << 0)
+#define CHUNK_END   (1 << 1)
+#define PARENT      (1 << 2)
+#define ROOT        (1 << 3)
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const uint8_t MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static inline uint32_t rotr32(uint32_t w, int c) {
+    return (w >> c) | (w << (32 - c));
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(uint8_t *p, uint32_t w) {
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static inline void g(uint32_t *s, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    s[a] = s[a] + s[b] + x;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + y;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+// Compress a block and return the first 8 words of the state in cv_out
+static void compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+                     uint8_t block_len, uint64_t counter, uint8_t flags, uint32_t cv_out[8]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++)
+        m[i] = load32(block + 4 * i);
+
+    uint32_t s[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        IV[0], IV[1], IV[2], IV[3],
+        (uint32_t)counter, (uint32_t)(counter >> 32), block_len, flags,
+    };
+
+    for (int r = 0; r < 7; r++) {
+        const uint8_t *k = MSG_SCHEDULE[r];
+        // Mix the columns
+        g(s, 0, 4, 8, 12, m[k[0]], m[k[1]]);
+        g(s, 1, 5, 9, 13, m[k[2]], m[k[3]]);
+        g(s, 2, 6, 10, 14, m[k[4]], m[k[5]]);
+        g(s, 3, 7, 11, 15, m[k[6]], m[k[7]]);
+        // Mix the diagonals
+        g(s, 0, 5, 10, 15, m[k[8]], m[k[9]]);
+        g(s, 1, 6, 11, 12, m[k[10]], m[k[11]]);
+        g(s, 2, 7, 8, 13, m[k[12]], m[k[13]]);
+        g(s, 3, 4, 9, 14, m[k[14]], m[k[15]]);
+    }
+
+    for (int i = 0; i < 8; i++)
+        cv_out[i] = s[i] ^ s[i + 8];
+}
+
+static void chunk_init(Blake3Chunk *chunk, uint64_t counter) {
+    memcpy(chunk->cv, IV, sizeof(IV));
+    chunk->counter = counter;
+    memset(chunk->block, 0, BLAKE3_BLOCK_LEN);
+    chunk->block_len = 0;
+    chunk->blocks_compressed = 0;
+}
+
+static size_t chunk_len(const Blake3Chunk *chunk) {
+    return (size_t)BLAKE3_BLOCK_LEN * chunk->blocks_compressed + chunk->block_len;
+}
+
+static uint8_t chunk_start_flag(const Blake3Chunk *chunk) {
+    return chunk->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+static void chunk_update(Blake3Chunk *chunk, const uint8_t *input, size_t len) {
+    while (len > 0) {
+        // The last block of a chunk is compressed by the output step, so a
+        // full block is compressed only when more input follows it
+        if (chunk->block_len == BLAKE3_BLOCK_LEN) {
+            compress(chunk->cv, chunk->block, BLAKE3_BLOCK_LEN, chunk->counter,
+                     chunk_start_flag(chunk), chunk->cv);
+            chunk->blocks_compressed++;
+            memset(chunk->block, 0, BLAKE3_BLOCK_LEN);
+            chunk->block_len = 0;
+        }
+
+        size_t take = BLAKE3_BLOCK_LEN - chunk->block_len;
+        if (take > len)
+            take = len;
+        memcpy(chunk->block + chunk->block_len, input, take);
+        chunk->block_len += (uint8_t)take;
+        input += take;
+        len -= take;
+    }
+}
+
+// Chaining value of a complete chunk
+static void chunk_cv(const Blake3Chunk *chunk, uint8_t flags, uint32_t cv_out[8]) {
+    compress(chunk->cv, chunk->block, chunk->block_len, chunk->counter,
+             flags | chunk_start_flag(chunk) | CHUNK_END, cv_out);
+}
+
+// Chaining value of a parent node, flags may add ROOT
+static void parent_cv(const uint32_t left[8], const uint32_t right[8], uint8_t flags, uint32_t cv_out[8]) {
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    for (int i = 0; i < 8; i++) {
+        store32(block + 4 * i, left[i]);
+        store32(block + 32 + 4 * i, right[i]);
+    }
+    compress(IV, block, BLAKE3_BLOCK_LEN, 0, PARENT | flags, cv_out);
+}
+
+void blake3_init(Blake3 *self) {
+    chunk_init(&self->chunk, 0);
+    self->cv_stack_len = 0;
+}
+
+// Push the chaining value of a complete chunk merging the complete subtrees:
+// the number of trailing zero bits of total_chunks is the number of merges
+static void push_chunk_cv(Blake3 *self, uint32_t cv[8], uint64_t total_chunks) {
+    while ((total_chunks & 1) == 0) {
+        self->cv_stack_len--;
+        parent_cv(self->cv_stack[self->cv_stack_len], cv, 0, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(self->cv_stack[self->cv_stack_len], cv, sizeof(uint32_t) * 8);
+    self->cv_stack_len++;
+}
+
+void blake3_update(Blake3 *self, const void *input, size_t len) {
+    const uint8_t *in = (const uint8_t *)input;
+
+    while (len > 0) {
+        // The chunk is complete and more input follows: it is not the root
+        if (chunk_len(&self->chunk) == BLAKE3_CHUNK_LEN) {
+            uint32_t cv[8];
+            chunk_cv(&self->chunk, 0, cv);
+            uint64_t total_chunks = self->chunk.counter + 1;
+            push_chunk_cv(self, cv, total_chunks);
+            chunk_init(&self->chunk, total_chunks);
+        }
+
+        size_t take = BLAKE3_CHUNK_LEN - chunk_len(&self->chunk);
+        if (take > len)
+            take = len;
+        chunk_update(&self->chunk, in, take);
+        in += take;
+        len -= take;
+    }
+}
+
+void blake3_final(const Blake3 *self, uint8_t out[BLAKE3_OUT_LEN]) {
+    uint32_t cv[8];
+
+    if (self->cv_stack_len == 0) {
+        // A single chunk is the root of the tree
+        chunk_cv(&self->chunk, ROOT, cv);
+    } else {
+        // Merge the last chunk with the subtrees from right to left,
+        // the last merge is the root
+        chunk_cv(&self->chunk, 0, cv);
+        for (int i = self->cv_stack_len - 1; i >= 0; i--)
+            parent_cv(self->cv_stack[i], cv, i == 0 ? ROOT : 0, cv);
+    }
+
+    for (int i = 0; i < 8; i++)
+        store32(out + 4 * i, cv[i]);
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../inc/bufferPool.h"
+
+/* Init the pool allocating all the buffers at once */
+void bufferpool_init(BufferPool *pool, int count, size_t buf_size) {
+    if (count < 1) {
+        count = 1;
+    }
+
+    pool->buffers = (Buffer*)malloc(sizeof(Buffer) * count);
+    pool->memory = (unsigned char*)malloc(buf_size * count);
+    if (pool->buffers == NULL || pool->memory == NULL) {
+        perror("Error during buffer pool allocation");
+        exit(1);
+    }
+
+    // First touch: place the pages on the NUMA node of the calling thread
+    memset(pool->memory, 0, buf_size * count);
+
+    pool->buf_size = buf_size;
+    pool->count = count;
+    pool->free_list = NULL;
+    for (int i = 0; i < count; i++) {
+        pool->buffers[i].data = pool->memory + (size_t)i * buf_size;
+        pool->buffers[i].len = 0;
+        pool->buffers[i].next = pool->free_list;
+        pool->free_list = &(pool->buffers[i]);
+    }
+
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_cond_init(&(pool->has_free), NULL);
+}
+
+/* Take a buffer, waiting until one is returned if the pool is empty */
+Buffer *bufferpool_get(BufferPool *pool) {
+    pthread_mutex_lock(&(pool->mutex));
+    while (pool->free_list == NULL) {
+        pthread_cond_wait(&(pool->has_free), &(pool->mutex));
+    }
+    Buffer *buf = pool->free_list;
+    pool->free_list = buf->next;
+    pthread_mutex_unlock(&(pool->mutex));
+
+    buf->len = 0;
+    buf->next = NULL;
+    return buf;
+}
+
+/* Give a buffer back to the pool */
+void bufferpool_put(BufferPool *pool, Buffer *buf) {
+    pthread_mutex_lock(&(pool->mutex));
+    buf->next = pool->free_list;
+    pool->free_list = buf;
+    pthread_cond_signal(&(pool->has_free));
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+/* Free the memory of the pool: all the buffers must have been returned */
+void bufferpool_destroy(BufferPool *pool) {
+    pthread_mutex_destroy(&(pool->mutex));
+    pthread_cond_destroy(&(pool->has_free));
+    free(pool->memory);
+    free(pool->buffers);
+}
+
+/* Init an empty chunk queue */
+void chunkqueue_init(ChunkQueue *q, int depth) {
+    q->front = NULL;
+    q->rear = NULL;
+    q->len = 0;
+    q->depth = depth < 1 ? 1 : depth;
+    q->started = 0;
+    pthread_mutex_init(&(q->mutex), NULL);
+    pthread_cond_init(&(q->not_empty), NULL);
+    pthread_cond_init(&(q->not_full), NULL);
+}
+
+/* Append a filled buffer, waiting while the hasher is `depth` buffers behind */
+void chunkqueue_push(ChunkQueue *q, Buffer *buf) {
+    buf->next = NULL;
+
+    pthread_mutex_lock(&(q->mutex));
+    while (q->len >= q->depth) {
+        pthread_cond_wait(&(q->not_full), &(q->mutex));
+    }
+
+    if (q->rear == NULL) {
+        q->front = buf;
+    } else {
+        q->rear->next = buf;
+    }
+    q->rear = buf;
+    q->len++;
+
+    pthread_cond_signal(&(q->not_empty));
+    pthread_mutex_unlock(&(q->mutex));
+}
+
+/* Remove the oldest buffer, waiting for the reader if the queue is empty */
+Buffer *chunkqueue_pop(ChunkQueue *q) {
+    pthread_mutex_lock(&(q->mutex));
+    while (q->len == 0) {
+        pthread_cond_wait(&(q->not_empty), &(q->mutex));
+    }
+
+    Buffer *buf = q->front;
+    q->front = buf->next;
+    if (q->front == NULL) {
+        q->rear = NULL;
+    }
+    q->len--;
+
+    pthread_cond_signal(&(q->not_full));
+    pthread_mutex_unlock(&(q->mutex));
+
+    buf->next = NULL;
+    return buf;
+}
+
+/* Called by the hasher before its first pop */
+void chunkqueue_start(ChunkQueue *q) {
+    pthread_mutex_lock(&(q->mutex));
+    q->started = 1;
+    pthread_cond_broadcast(&(q->not_full));
+    pthread_mutex_unlock(&(q->mutex));
+}
+
+/* Wait until a hasher consumes the queue. A reader that takes buffers only
+   after this point never holds them for a job nobody is hashing yet */
+void chunkqueue_wait_started(ChunkQueue *q) {
+    pthread_mutex_lock(&(q->mutex));
+    while (!q->started) {
+        pthread_cond_wait(&(q->not_full), &(q->mutex));
+    }
+    pthread_mutex_unlock(&(q->mutex));
+}
+
+/* Release the synchronization objects of an empty queue */
+void chunkqueue_destroy(ChunkQueue *q) {
+    pthread_mutex_destroy(&(q->mutex));
+    pthread_cond_destroy(&(q->not_empty));
+    pthread_cond_destroy(&(q->not_full));
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../inc/chunkIndex.h"
+
+// FNV-1a hash of the key
+static unsigned int file_hash(const char *key) {
+    unsigned int hash = 2166136261u;
+    while (*key != '\0') {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+        key++;
+    }
+    return hash % CHUNK_FILE_TABLE_SIZE;
+}
+
+// The digests are already uniform: their first bytes are the hash
+static size_t chunk_hash(const unsigned char *digest, size_t numBuckets) {
+    unsigned long long hash;
+    memcpy(&hash, digest, sizeof(hash));
+    return (size_t)(hash & (numBuckets - 1));
+}
+
+static ChunkEntry **alloc_buckets(size_t numBuckets) {
+    ChunkEntry **buckets = calloc(numBuckets, sizeof(ChunkEntry *));
+    if (!buckets) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return buckets;
+}
+
+// Double the chunk table when it holds a chunk per bucket on average
+static void grow_chunks(ChunkIndex *ci) {
+    size_t numBuckets = ci->numBuckets * 2;
+    ChunkEntry **buckets = alloc_buckets(numBuckets);
+
+    for (size_t i = 0; i < ci->numBuckets; i++) {
+        ChunkEntry *entry = ci->chunks[i];
+        while (entry != NULL) {
+            ChunkEntry *next = entry->next;
+            size_t index = chunk_hash(entry->digest, numBuckets);
+            entry->next = buckets[index];
+            buckets[index] = entry;
+            entry = next;
+        }
+    }
+    free(ci->chunks);
+    ci->chunks = buckets;
+    ci->numBuckets = numBuckets;
+}
+
+ChunkIndex *create_chunk_index() {
+    ChunkIndex *ci = malloc(sizeof(ChunkIndex));
+    if (!ci) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < CHUNK_FILE_TABLE_SIZE; i++) {
+        ci->files[i] = NULL;
+    }
+    ci->numBuckets = CHUNK_INDEX_MIN_BUCKETS;
+    ci->chunks = alloc_buckets(ci->numBuckets);
+    ci->numChunks = 0;
+    slab_init(&ci->fileEntries, sizeof(ChunkFile), CHUNKS_PER_SLAB / 16);
+    slab_init(&ci->chunkEntries, sizeof(ChunkEntry), CHUNKS_PER_SLAB);
+    return ci;
+}
+
+// Count one more occurrence of a chunk
+static void add_chunk(ChunkIndex *ci, const unsigned char *digest) {
+    size_t index = chunk_hash(digest, ci->numBuckets);
+    ChunkEntry *entry = ci->chunks[index];
+
+    while (entry != NULL) {
+        if (memcmp(entry->digest, digest, CHUNK_DIGEST_SIZE) == 0) {
+            entry->occurrences++;
+            return;
+        }
+        entry = entry->next;
+    }
+
+    entry = slab_alloc(&ci->chunkEntries);
+    if (!entry) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry->digest, digest, CHUNK_DIGEST_SIZE);
+    entry->occurrences = 1;
+    entry->next = ci->chunks[index];
+    ci->chunks[index] = entry;
+
+    if (++ci->numChunks > ci->numBuckets)
+        grow_chunks(ci);
+}
+
+// Count one less occurrence of a chunk, forget it at zero
+static void remove_chunk(ChunkIndex *ci, const unsigned char *digest) {
+    size_t index = chunk_hash(digest, ci->numBuckets);
+    ChunkEntry *entry = ci->chunks[index];
+    ChunkEntry *prev = NULL;
+
+    while (entry != NULL) {
+        if (memcmp(entry->digest, digest, CHUNK_DIGEST_SIZE) == 0) {
+            if (--entry->occurrences == 0) {
+                if (prev == NULL)
+                    ci->chunks[index] = entry->next;
+                else
+                    prev->next = entry->next;
+                slab_free(&ci->chunkEntries, entry);
+                ci->numChunks--;
+            }
+            return;
+        }
+        prev = entry;
+        entry = entry->next;
+    }
+}
+
+void chunk_index_put_file(ChunkIndex *ci, const char *inode, const char *identity, const ChunkList *list) {
+    if (strlen(inode) >= FILE_INODE_KEY_SIZE || strlen(identity) >= FILE_IDENTITY_SIZE)
+        return;
+
+    unsigned int index = file_hash(inode);
+    ChunkFile *file = ci->files[index];
+    while (file != NULL && strcmp(file->inode, inode) != 0)
+        file = file->next;
+
+    if (file != NULL) {
+        if (strcmp(file->identity, identity) == 0)
+            return;
+        // The file changed: its old chunks are not in it anymore
+        for (int i = 0; i < file->count; i++)
+            remove_chunk(ci, file->chunks[i].digest);
+        free(file->chunks);
+    } else {
+        file = slab_alloc(&ci->fileEntries);
+        if (!file) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        strcpy(file->inode, inode);
+        file->next = ci->files[index];
+        ci->files[index] = file;
+    }
+
+    struct ChunkInfo *chunks = malloc(sizeof(struct ChunkInfo) * (list->count > 0 ? list->count : 1));
+    if (!chunks) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(file->identity, identity);
+    memcpy(chunks, list->chunks, sizeof(struct ChunkInfo) * list->count);
+    file->chunks = chunks;
+    file->count = list->count;
+
+    for (int i = 0; i < list->count; i++)
+        add_chunk(ci, list->chunks[i].digest);
+}
+
+int chunk_index_get_file(ChunkIndex *ci, const char *inode, const char *identity, ChunkList *list) {
+    for (ChunkFile *file = ci->files[file_hash(inode)]; file != NULL; file = file->next) {
+        if (strcmp(file->inode, inode) == 0) {
+            if (strcmp(file->identity, identity) != 0)
+                return -1;
+            for (int i = 0; i < file->count; i++)
+                chunklist_append(list, &file->chunks[i]);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+unsigned int chunk_index_occurrences(ChunkIndex *ci, const unsigned char *digest) {
+    ChunkEntry *entry = ci->chunks[chunk_hash(digest, ci->numBuckets)];
+    while (entry != NULL) {
+        if (memcmp(entry->digest, digest, CHUNK_DIGEST_SIZE) == 0)
+            return entry->occurrences;
+        entry = entry->next;
+    }
+    return 0;
+}
+
+void free_chunk_index(ChunkIndex *ci) {
+    // The chunk lists are the only memory outside the slabs
+    for (int i = 0; i < CHUNK_FILE_TABLE_SIZE; i++) {
+        for (ChunkFile *file = ci->files[i]; file != NULL; file = file->next)
+            free(file->chunks);
+    }
+    slab_destroy(&ci->fileEntries);
+    slab_destroy(&ci->chunkEntries);
+    free(ci->chunks);
+    free(ci);
+}
@@ -0,0 +1,305 @@
+// SHA256_CTX is the low level API deprecated by OpenSSL 3, the state of a
+// chunk lives in the Chunker without allocations
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../inc/chunker.h"
+
+// The hash is shifted left once per byte, so its top bits depend on the
+// last 64 bytes: the masks test the top bits. The harder mask (avg/4)
+// is used below the normal size, the easier one (avg*4) above it.
+#define CDC_MASK_S (~0ULL << (64 - 15))
+#define CDC_MASK_L (~0ULL << (64 - 11))
+
+// After GEAR_WINDOW bytes a byte is shifted out of the hash: the hash of a
+// position depends only on the window of bytes ending there. Hashing starts
+// a window before the minimum size, so every position tested has a full
+// window, and positions far apart can be tested independently. A block is
+// tested by 4 lanes at once, each one hashing the window before its
+// segment and then testing the segment. Long segments waste less on the
+// windows, short ones less past the cut: a segment is a fraction of the
+// average distance between cuts of the mask.
+#define GEAR_WINDOW 64
+#define SCAN_LANES 4
+#define SCAN_SEGMENT_MIN 128
+#define SCAN_SEGMENT_S 2048
+#define SCAN_SEGMENT_L 256
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SCAN_AVX2
+#endif
+
+static uint64_t gear[256];
+static pthread_once_t gearOnce = PTHREAD_ONCE_INIT;
+
+// Test the SCAN_LANES * segment positions from data[0] against `mask`, the
+// window before data[0] must be readable. Return the bit mask of the lanes
+// with a cut, *last is set to the hash of the last position of the block
+typedef unsigned int (*ScanBlock)(const unsigned char *data, size_t segment, uint64_t mask, uint64_t *last);
+
+#define GEAR_STEP(h, d, t) (((h) << 1) + gear[(d)[t]])
+
+// Independent lanes: the CPU runs their hash chains in parallel. A position
+// matches if the top bits of its hash are 0, so a lane keeps just its
+// smallest hash
+static unsigned int scan_block(const unsigned char *data, size_t segment, uint64_t mask, uint64_t *last) {
+    const unsigned char *d0 = data, *d1 = data + segment;
+    const unsigned char *d2 = data + 2 * segment, *d3 = data + 3 * segment;
+    uint64_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+    uint64_t m0 = ~0ULL, m1 = ~0ULL, m2 = ~0ULL, m3 = ~0ULL;
+
+    for (ptrdiff_t t = -GEAR_WINDOW; t < 0; t++) {
+        h0 = GEAR_STEP(h0, d0, t);
+        h1 = GEAR_STEP(h1, d1, t);
+        h2 = GEAR_STEP(h2, d2, t);
+        h3 = GEAR_STEP(h3, d3, t);
+    }
+    for (size_t t = 0; t < segment; t++) {
+        h0 = GEAR_STEP(h0, d0, t);
+        h1 = GEAR_STEP(h1, d1, t);
+        h2 = GEAR_STEP(h2, d2, t);
+        h3 = GEAR_STEP(h3, d3, t);
+        m0 = h0 < m0 ? h0 : m0;
+        m1 = h1 < m1 ? h1 : m1;
+        m2 = h2 < m2 ? h2 : m2;
+        m3 = h3 < m3 ? h3 : m3;
+    }
+
+    *last = h3;
+    return (unsigned int)!(m0 & mask) | (unsigned int)!(m1 & mask) << 1 |
+           (unsigned int)!(m2 & mask) << 2 | (unsigned int)!(m3 & mask) << 3;
+}
+
+#ifdef HAVE_SCAN_AVX2
+// Same as scan_block, a lane per 64-bit element. The gear values are loaded
+// one by one: the AVX2 gather is slower than that on many CPUs.
+__attribute__((target("avx2")))
+static unsigned int scan_block_avx2(const unsigned char *data, size_t segment, uint64_t mask, uint64_t *last) {
+    const unsigned char *d0 = data, *d1 = data + segment;
+    const unsigned char *d2 = data + 2 * segment, *d3 = data + 3 * segment;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i masks = _mm256_set1_epi64x((long long)mask);
+    __m256i hash = zero;
+    __m256i hit = zero;
+
+    for (ptrdiff_t t = -GEAR_WINDOW; t < 0; t++) {
+        __m256i g = _mm256_set_epi64x((long long)gear[d3[t]], (long long)gear[d2[t]],
+                                      (long long)gear[d1[t]], (long long)gear[d0[t]]);
+        hash = _mm256_add_epi64(_mm256_slli_epi64(hash, 1), g);
+    }
+    for (size_t t = 0; t < segment; t++) {
+        __m256i g = _mm256_set_epi64x((long long)gear[d3[t]], (long long)gear[d2[t]],
+                                      (long long)gear[d1[t]], (long long)gear[d0[t]]);
+        hash = _mm256_add_epi64(_mm256_slli_epi64(hash, 1), g);
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi64(_mm256_and_si256(hash, masks), zero));
+    }
+
+    *last = (uint64_t)_mm256_extract_epi64(hash, 3);
+    return (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(hit));
+}
+#endif
+
+static ScanBlock scanBlock = scan_block;
+
+// Random values of the bytes, from a fixed seed: every server cuts a file
+// at the same boundaries
+static void gear_init(void) {
+    uint64_t state = 0x5348413235364344ULL;
+    for (int i = 0; i < 256; i++) {
+        // splitmix64
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+
+#ifdef HAVE_SCAN_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scanBlock = scan_block_avx2;
+#endif
+}
+
+// Return the first position in [i, end) of data whose hash matches `mask`,
+// `end` if none, testing blocks of lanes of up to `maxSegment` positions.
+// *hash is the hash before data[i], it is updated to the hash of the last
+// position tested
+static size_t scan(const unsigned char *data, size_t i, size_t end, uint64_t mask,
+                   size_t maxSegment, uint64_t *hash) {
+    uint64_t h = *hash;
+
+    // The window of the first positions is partly in the previous buffer:
+    // they are tested one by one, from the hash carried over
+    for (; i < end && i < GEAR_WINDOW; i++) {
+        h = (h << 1) + gear[data[i]];
+        if (!(h & mask)) {
+            *hash = h;
+            return i;
+        }
+    }
+
+    for (;;) {
+        size_t segment = (end - i) / SCAN_LANES;
+        if (segment > maxSegment)
+            segment = maxSegment;
+        if (segment < SCAN_SEGMENT_MIN)
+            break;
+
+        unsigned int lanes = scanBlock(data + i, segment, mask, &h);
+        if (lanes == 0) {
+            i += SCAN_LANES * segment;
+            continue;
+        }
+
+        // The cut is in the first lane that found one: find it there
+        int k = 0;
+        while (!(lanes & (1u << k)))
+            k++;
+        i += (size_t)k * segment;
+        h = 0;
+        for (size_t j = i - GEAR_WINDOW; j < i; j++)
+            h = (h << 1) + gear[data[j]];
+        for (;; i++) {
+            h = (h << 1) + gear[data[i]];
+            if (!(h & mask)) {
+                *hash = h;
+                return i;
+            }
+        }
+    }
+
+    for (; i < end; i++) {
+        h = (h << 1) + gear[data[i]];
+        if (!(h & mask)) {
+            *hash = h;
+            return i;
+        }
+    }
+    *hash = h;
+    return end;
+}
+
+// Scan `data` for the end of the current chunk. Return how many bytes
+// belong to it, *cut is set if the chunk ends there.
+static size_t find_cut(Chunker *c, const unsigned char *data, size_t n, int *cut) {
+    uint64_t hash = c->hash;
+    size_t start = c->length;
+    size_t i = 0;
+    size_t end;
+
+    *cut = 0;
+
+    // No boundary can fall before the minimum size: only the window before
+    // it is hashed, without testing
+    if (start < CDC_MIN_SIZE - GEAR_WINDOW) {
+        i = CDC_MIN_SIZE - GEAR_WINDOW - start;
+        if (i >= n)
+            return n;
+    }
+    for (; start + i < CDC_MIN_SIZE; i++) {
+        if (i == n) {
+            c->hash = hash;
+            return n;
+        }
+        hash = (hash << 1) + gear[data[i]];
+    }
+
+    // Below the normal size only the harder mask cuts
+    if (start + i < CDC_NORMAL_SIZE) {
+        end = CDC_NORMAL_SIZE - start;
+        if (end > n)
+            end = n;
+        i = scan(data, i, end, CDC_MASK_S, SCAN_SEGMENT_S, &hash);
+        if (i < end) {
+            *cut = 1;
+            return i + 1;
+        }
+    }
+
+    end = CDC_MAX_SIZE - start;
+    if (end > n)
+        end = n;
+    i = scan(data, i, end, CDC_MASK_L, SCAN_SEGMENT_L, &hash);
+    if (i < end) {
+        *cut = 1;
+        return i + 1;
+    }
+
+    c->hash = hash;
+    if (start + i == CDC_MAX_SIZE)
+        *cut = 1;
+    return i;
+}
+
+// Close the current chunk and start the next one
+static void emit_chunk(Chunker *c, ChunkList *list) {
+    struct ChunkInfo chunk;
+
+    chunk.offset = c->offset;
+    chunk.length = (unsigned int)c->length;
+    chunk.occurrences = 0;
+    SHA256_Final(chunk.digest, &c->sha256);
+    chunklist_append(list, &chunk);
+
+    c->offset += (long long)c->length;
+    c->length = 0;
+    c->hash = 0;
+    SHA256_Init(&c->sha256);
+}
+
+void chunker_init(Chunker *c) {
+    pthread_once(&gearOnce, gear_init);
+    c->hash = 0;
+    c->length = 0;
+    c->offset = 0;
+    SHA256_Init(&c->sha256);
+}
+
+void chunker_update(Chunker *c, const unsigned char *data, size_t n, ChunkList *list) {
+    while (n > 0) {
+        int cut;
+        size_t used = find_cut(c, data, n, &cut);
+
+        SHA256_Update(&c->sha256, data, used);
+        c->length += used;
+        data += used;
+        n -= used;
+
+        if (cut)
+            emit_chunk(c, list);
+    }
+}
+
+void chunker_final(Chunker *c, ChunkList *list) {
+    if (c->length > 0)
+        emit_chunk(c, list);
+}
+
+void chunklist_init(ChunkList *list) {
+    list->chunks = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void chunklist_append(ChunkList *list, const struct ChunkInfo *chunk) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        struct ChunkInfo *chunks = realloc(list->chunks, sizeof(struct ChunkInfo) * capacity);
+        if (!chunks) {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        list->chunks = chunks;
+        list->capacity = capacity;
+    }
+    list->chunks[list->count++] = *chunk;
+}
+
+void chunklist_free(ChunkList *list) {
+    free(list->chunks);
+    chunklist_init(list);
+}
@@ -1,104 +1,132 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
-
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "requestResponse.h"
+#include "../inc/sha256Client.h"
 #include "../inc/errExit.h"
 
-char *path2ServerFIFO = "/tmp/fifoServer";
-char *baseClientFIFO = "/tmp/fifoClient";
-
-#define MAX 100
 #define TIMEOUT_SECONDS 10
-
-int main (int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <file_path>\n", argv[0]);
-        exit(EXIT_FAILURE);
+#define USAGE "Usage: %s [-a sha256,sha512-256,sha1,blake3] [-c] [-l] <file_path>...\n"
+
+static const char *digestNames[DIGEST_COUNT] = DIGEST_NAMES;
+
+// Parse a list like "sha256,blake3" into a DIGEST_BIT mask, 0 if malformed
+static unsigned int parse_algorithms(char *list) {
+    unsigned int mask = 0;
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        int algo = 0;
+        while (algo < DIGEST_COUNT && strcmp(name, digestNames[algo]) != 0)
+            algo++;
+        if (algo == DIGEST_COUNT)
+            return 0;
+        mask |= DIGEST_BIT(algo);
     }
+    return mask;
+}
 
-    // Step-1: The client makes a FIFO in /tmp
-    char path2ClientFIFO[25];
-    sprintf(path2ClientFIFO, "%s%d", baseClientFIFO, getpid());
-
-    printf("<Client> Starting client...\n");
-    if (mkfifo(path2ClientFIFO, S_IRUSR | S_IWUSR | S_IWGRP) == -1)
-        errExit("mkfifo failed");
-
-    printf("<Client> FIFO %s created\n", path2ClientFIFO);
-
-    // Step-2: Open server FIFO to send request
-    printf("<Client> Opening server FIFO %s...\n", path2ServerFIFO);
-    int serverFIFO = open(path2ServerFIFO, O_WRONLY);
-    if (serverFIFO == -1)
-        errExit("Write-only server fifo opening failed");
-
-    // Prepare a request
-    struct Request request;
-    request.cPid = getpid();
-
-    // Copy filename from command line argument
-    strncpy(request.fileName, argv[1], MAX_FILENAME_SIZE - 1);
-    request.fileName[MAX_FILENAME_SIZE - 1] = '\0'; // Ensure null-termination
-
-    // Step-3: Send request
-    printf("<Client> Sending %s\n", request.fileName);
-    if (write(serverFIFO, &request, sizeof(struct Request)) != sizeof(struct Request))
-        errExit("Write-only client fifo opening failed");
-
-    // Step-4: Open own FIFO for response
-    int clientFIFO = open(path2ClientFIFO, O_RDONLY);
-    if (clientFIFO == -1)
-        errExit("Read-only client fifo opening failed");
-
-    fd_set read_fds;
-    struct timeval timeout;
-    int retval;
-
-    // Pulisce il set di file descriptor
-    FD_ZERO(&read_fds);
-    // Aggiunge il file descriptor del clientFIFO al set
-    FD_SET(clientFIFO, &read_fds);
+// Print the content-defined chunks of a file, the duplicates are marked
+static void print_chunks(const Sha256Result *result) {
+    for (int i = 0; i < result->numChunks; i++) {
+        const struct ChunkInfo *chunk = &result->chunks[i];
+        char hex[2 * CHUNK_DIGEST_SIZE + 1];
+        for (int j = 0; j < CHUNK_DIGEST_SIZE; j++)
+            sprintf(hex + 2 * j, "%02x", chunk->digest[j]);
+
+        if (chunk->occurrences > 1)
+            printf("<Client> Chunk %s %lld+%u %s duplicate x%u\n", result->fileName,
+                   chunk->offset, chunk->length, hex, chunk->occurrences);
+        else
+            printf("<Client> Chunk %s %lld+%u %s\n", result->fileName,
+                   chunk->offset, chunk->length, hex);
+    }
+}
 
-    // Imposta la struttura timeval per il timeout
-    timeout.tv_sec = TIMEOUT_SECONDS;
-    timeout.tv_usec = 0;
+// Print the response of a file, count the failed requests in `userData`
+static void print_result(const Sha256Result *result, void *userData) {
+    int *failures = userData;
 
-    printf("<Client> Waiting for a response (timeout: %d seconds)...\n", TIMEOUT_SECONDS);
+    // The chunks come before the digests of the whole file
+    print_chunks(result);
+    if (result->more)
+        return;
 
-    // Step-5: Wait for a response with a timeout
-    retval = select(clientFIFO + 1, &read_fds, NULL, NULL, &timeout);
+    if (result->status == SHA256_TIMEOUT) {
+        printf("<Client> Timeout occurred! No response for %s after %d seconds.\n",
+               result->fileName, TIMEOUT_SECONDS);
+        (*failures)++;
+        return;
+    }
+    if (result->status == RESPONSE_BUSY) {
+        printf("<Client> Server busy, request rejected: %s\n", result->message);
+        (*failures)++;
+        return;
+    }
+    if (result->status != RESPONSE_OK) {
+        printf("<Client> Server response: %s\n", result->message);
+        (*failures)++;
+        return;
+    }
+    if (result->algorithms == DIGEST_BIT(DIGEST_SHA256)) {
+        printf("<Client> Server response: %s %s\n", result->message, result->fileName);
+    } else {
+        // One line per digest
+        for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+            if (result->algorithms & DIGEST_BIT(algo))
+                printf("<Client> Server response: %s %s %s\n", digestNames[algo],
+                       result->digests[algo], result->fileName);
+        }
+    }
+}
 
-    if (retval == -1) {
-        errExit("select() failed");
-    } else if (retval) {
-        printf("<Client> Data is available, reading response...\n");
-        struct Response response;
-        if (read(clientFIFO, &response, sizeof(struct Response)) != sizeof(struct Response)) {
-            errExit("Server response reading failed");
+int main (int argc, char *argv[]) {
+    unsigned int algorithms = DIGEST_BIT(DIGEST_SHA256);
+    int opt;
+    unsigned int options = 0;
+    while ((opt = getopt(argc, argv, "a:cl")) != -1) {
+        if (opt == 'c') {
+            options |= REQUEST_CHUNKS;
+        } else if (opt == 'l') {
+            // Logs and the like, only ever appended to
+            options |= REQUEST_APPEND_ONLY;
+        } else if (opt != 'a' || (algorithms = parse_algorithms(optarg)) == 0) {
+            fprintf(stderr, USAGE, argv[0]);
+            exit(EXIT_FAILURE);
         }
-        // Step-6: Print server response
-        printf("<Client> Server response: %s\n", response.hashCode);
-    } else {
-        // Timeout scaduto
-        printf("<Client> Timeout occurred! No response from server after %d seconds.\n", TIMEOUT_SECONDS);
-        // Esci dal programma con un codice di errore
+    }
+    if (optind >= argc) {
+        fprintf(stderr, USAGE, argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Step-7: Close FIFOs
-    if (close(serverFIFO) != 0 || close(clientFIFO) != 0)
-        errExit("Client fifo closing failed");
+    // Step-1: Open a session, its FIFO is shared by all the requests
+    printf("<Client> Starting client...\n");
+    Sha256Session *session = sha256_session_open();
+    if (session == NULL)
+        errExit("Session opening failed");
+
+    // Step-2: Send all the requests, the session keeps at most a window of
+    // them at the server and sends the others as responses arrive
+    int failures = 0;
+    for (int i = optind; i < argc; i++) {
+        printf("<Client> Sending %s\n", argv[i]);
+        if (sha256_submit(session, argv[i], algorithms | options, TIMEOUT_SECONDS * 1000,
+                          print_result, &failures) == 0) {
+            perror("<Client> Request sending failed");
+            failures++;
+        }
+    }
+
+    // Step-3: Print the responses as they arrive
+    printf("<Client> Waiting for the responses (timeout: %d seconds)...\n", TIMEOUT_SECONDS);
+    while (sha256_pending(session) > 0) {
+        if (sha256_poll(session, -1) == -1)
+            errExit("Response reading failed");
+    }
 
-    // Step-8: Remove own FIFO
-    if (unlink(path2ClientFIFO) != 0)
-        errExit("Client fifo unlink failed");
+    // Step-4: Close the session and remove its FIFO
+    sha256_session_close(session);
 
-    return 0;
+    return failures == 0 ? 0 : EXIT_FAILURE;
 }
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../inc/cpuTopology.h"
+
+#define NODE_PATH "/sys/devices/system/node/node%d/cpulist"
+
+static int num_nodes = 0;
+static int node_cpus[MAX_NUMA_NODES][MAX_CPUS];
+static int node_num_cpus[MAX_NUMA_NODES];
+static int cpu_node[MAX_CPUS];          // dense node index of each CPU
+static cpu_set_t initial_cpus;          // affinity the process was started with
+
+// Parse a list like "0-3,8,10-11" into cpus
+int parse_cpu_list(const char *list, int *cpus, int max) {
+    int n = 0;
+    const char *p = list;
+
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && n < max; cpu++) {
+            cpus[n++] = (int)cpu;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0' && *p != '\n') {
+            return -1;
+        }
+    }
+    return n;
+}
+
+// Read the CPU list of every node exported by the kernel
+void topology_init(void) {
+    char path[64];
+    char line[4096];
+
+    num_nodes = 0;
+    memset(cpu_node, 0, sizeof(cpu_node));
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &initial_cpus) != 0) {
+        perror("Error reading the CPU affinity");
+        CPU_ZERO(&initial_cpus);
+    }
+
+    for (int id = 0; id < MAX_CPUS && num_nodes < MAX_NUMA_NODES; id++) {
+        sprintf(path, NODE_PATH, id);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            continue; // node ids can be sparse
+        }
+        int n = 0;
+        if (fgets(line, sizeof(line), file) != NULL) {
+            n = parse_cpu_list(line, node_cpus[num_nodes], MAX_CPUS);
+        }
+        fclose(file);
+
+        if (n > 0) { // memory-only nodes have no CPUs to run workers on
+            node_num_cpus[num_nodes] = n;
+            for (int i = 0; i < n; i++) {
+                if (node_cpus[num_nodes][i] < MAX_CPUS)
+                    cpu_node[node_cpus[num_nodes][i]] = num_nodes;
+            }
+            num_nodes++;
+        }
+    }
+
+    // No NUMA support: a single node with every online CPU
+    if (num_nodes == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        if (online < 1) online = 1;
+        if (online > MAX_CPUS) online = MAX_CPUS;
+        for (int i = 0; i < online; i++) {
+            node_cpus[0][i] = i;
+        }
+        node_num_cpus[0] = (int)online;
+        num_nodes = 1;
+    }
+}
+
+int topology_num_nodes(void) {
+    return num_nodes;
+}
+
+int topology_node_cpus(int node, int *cpus, int max) {
+    if (node < 0 || node >= num_nodes) {
+        return 0;
+    }
+    int n = node_num_cpus[node] < max ? node_num_cpus[node] : max;
+    memcpy(cpus, node_cpus[node], sizeof(int) * n);
+    return n;
+}
+
+int topology_node_of_cpu(int cpu) {
+    if (cpu < 0 || cpu >= MAX_CPUS) {
+        return 0;
+    }
+    return cpu_node[cpu];
+}
+
+int topology_current_node(void) {
+    return topology_node_of_cpu(sched_getcpu());
+}
+
+int topology_bind_current_thread(const int *cpus, int n) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (n == 0) {
+        set = initial_cpus;
+    } else {
+        for (int i = 0; i < n; i++) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+}
@@ -0,0 +1,107 @@
+// SHA256_CTX is the low level API deprecated by OpenSSL 3, it is the only
+// one whose state can be copied and restored without allocations
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/digest.h"
+
+static const char *names[DIGEST_COUNT] = DIGEST_NAMES;
+
+// Contexts of the OpenSSL algorithms, allocated once per thread
+static __thread EVP_MD_CTX *threadCtx[DIGEST_COUNT];
+
+// OpenSSL implementation of an algorithm, NULL if it is computed here
+static const EVP_MD *evp_md(int algo) {
+    switch (algo) {
+        case DIGEST_SHA512_256: return EVP_sha512_256();
+        case DIGEST_SHA1:       return EVP_sha1();
+        default:                return NULL;
+    }
+}
+
+int digest_init(DigestCtx *ctx, unsigned int algorithms) {
+    if (algorithms == 0)
+        algorithms = DIGEST_BIT(DIGEST_SHA256);
+    ctx->algorithms = algorithms & DIGEST_ALL;
+
+    for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+        ctx->evp[algo] = NULL;
+        if (!(ctx->algorithms & DIGEST_BIT(algo)))
+            continue;
+
+        if (algo == DIGEST_SHA256) {
+            SHA256_Init(&ctx->sha256);
+            continue;
+        }
+        const EVP_MD *md = evp_md(algo);
+        if (md == NULL) {
+            blake3_init(&ctx->blake3);
+            continue;
+        }
+        if (threadCtx[algo] == NULL && (threadCtx[algo] = EVP_MD_CTX_new()) == NULL) {
+            perror("Error during digest allocation");
+            return -1;
+        }
+        if (EVP_DigestInit_ex(threadCtx[algo], md, NULL) != 1) {
+            fprintf(stderr, "Error during %s initialization\n", names[algo]);
+            return -1;
+        }
+        ctx->evp[algo] = threadCtx[algo];
+    }
+    return 0;
+}
+
+void digest_update(DigestCtx *ctx, const void *data, size_t len) {
+    for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+        if (ctx->evp[algo] != NULL)
+            EVP_DigestUpdate(ctx->evp[algo], data, len);
+    }
+    if (ctx->algorithms & DIGEST_BIT(DIGEST_SHA256))
+        SHA256_Update(&ctx->sha256, data, len);
+    if (ctx->algorithms & DIGEST_BIT(DIGEST_BLAKE3))
+        blake3_update(&ctx->blake3, data, len);
+}
+
+void digest_resume_sha256(DigestCtx *ctx, const SHA256_CTX *midstate) {
+    ctx->sha256 = *midstate;
+}
+
+void digest_sha256_midstate(const DigestCtx *ctx, SHA256_CTX *midstate) {
+    *midstate = ctx->sha256;
+}
+
+// Write `len` bytes in hex format
+static void to_hex(const unsigned char *bytes, unsigned int len, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (unsigned int i = 0; i < len; i++) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0xf];
+    }
+    hex[2 * len] = '\0';
+}
+
+void digest_final(DigestCtx *ctx, char hex[DIGEST_COUNT][DIGEST_HEX_SIZE]) {
+    unsigned char bytes[EVP_MAX_MD_SIZE];
+    unsigned int len;
+
+    for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+        hex[algo][0] = '\0';
+        if (ctx->evp[algo] != NULL) {
+            EVP_DigestFinal_ex(ctx->evp[algo], bytes, &len);
+            to_hex(bytes, len, hex[algo]);
+        }
+    }
+    if (ctx->algorithms & DIGEST_BIT(DIGEST_SHA256)) {
+        SHA256_Final(bytes, &ctx->sha256);
+        to_hex(bytes, SHA256_DIGEST_LENGTH, hex[DIGEST_SHA256]);
+    }
+    if (ctx->algorithms & DIGEST_BIT(DIGEST_BLAKE3)) {
+        blake3_final(&ctx->blake3, bytes);
+        to_hex(bytes, BLAKE3_OUT_LEN, hex[DIGEST_BLAKE3]);
+    }
+}
+
+const char *digest_name(int algo) {
+    return algo >= 0 && algo < DIGEST_COUNT ? names[algo] : "unknown";
+}
@@ -26,11 +26,15 @@ HashTable *create_hash_table() {
     for (int i = 0; i < TABLE_SIZE; i++) {
         ht->table[i] = NULL;
     }
+    slab_init(&ht->entries, sizeof(Entry), ENTRIES_PER_SLAB);
     return ht;
 }
 
 // Insert a key-value pair into the hash table
 void hash_table_insert(HashTable *ht, const char *key, const char *value) {
+    if (strlen(key) >= MAX_KEY_SIZE || strlen(value) >= MAX_VALUE_SIZE)
+        return;
+
     unsigned int index = hash(key);
     Entry *entry = ht->table[index];
 
@@ -38,21 +42,20 @@ void hash_table_insert(HashTable *ht, const char *key, const char *value) {
     while (entry != NULL) {
         // if the key already exists update the value instead of inserting a duplicate
         if (strcmp(entry->key, key) == 0) {
-            free(entry->value);
-            entry->value = strdup(value);
+            strcpy(entry->value, value);
             return;
         }
         entry = entry->next;
     }
 
     // Insert new entry at the head (fast insert) of the list because the key was not found!
-    Entry *new_entry = malloc(sizeof(Entry));
+    Entry *new_entry = slab_alloc(&ht->entries);
     if (!new_entry) {
         perror("malloc failed");
         exit(EXIT_FAILURE);
     }
-    new_entry->key = strdup(key);
-    new_entry->value = strdup(value);
+    strcpy(new_entry->key, key);
+    strcpy(new_entry->value, value);
     new_entry->next = ht->table[index];
     ht->table[index] = new_entry;
 }
@@ -82,9 +85,7 @@ void hash_table_remove(HashTable *ht, const char *key) {
             else
                 prev->next = entry->next;
 
-            free(entry->key);
-            free(entry->value);
-            free(entry);
+            slab_free(&ht->entries, entry);
             return;
         }
         prev = entry;
@@ -94,15 +95,7 @@ void hash_table_remove(HashTable *ht, const char *key) {
 
 // Free the hash table and all its entries
 void free_hash_table(HashTable *ht) {
-    for (int i = 0; i < TABLE_SIZE; i++) {
-        Entry *entry = ht->table[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            free(entry->key);
-            free(entry->value);
-            free(entry);
-            entry = next;
-        }
-    }
+    // The entries live in the slabs of the table
+    slab_destroy(&ht->entries);
     free(ht);
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../inc/midstateTable.h"
+
+// FNV-1a hash of the key
+static unsigned int midstate_hash(const char *key) {
+    unsigned int hash = 2166136261u;
+    while (*key != '\0') {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+        key++;
+    }
+    return hash % MIDSTATE_TABLE_SIZE;
+}
+
+MidstateTable *create_midstate_table() {
+    MidstateTable *mt = malloc(sizeof(MidstateTable));
+    if (!mt) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < MIDSTATE_TABLE_SIZE; i++) {
+        mt->table[i] = NULL;
+    }
+    slab_init(&mt->entries, sizeof(Midstate), MIDSTATES_PER_SLAB);
+    return mt;
+}
+
+int midstate_table_get(MidstateTable *mt, const char *key, Midstate *out) {
+    Midstate *entry = mt->table[midstate_hash(key)];
+    while (entry != NULL) {
+        if (strcmp(entry->key, key) == 0) {
+            *out = *entry;
+            out->next = NULL;
+            return 0;
+        }
+        entry = entry->next;
+    }
+    return -1;
+}
+
+void midstate_table_put(MidstateTable *mt, const Midstate *m) {
+    unsigned int index = midstate_hash(m->key);
+    Midstate *entry = mt->table[index];
+
+    // Replace the midstate of a file already in the table
+    while (entry != NULL) {
+        if (strcmp(entry->key, m->key) == 0) {
+            Midstate *next = entry->next;
+            *entry = *m;
+            entry->next = next;
+            return;
+        }
+        entry = entry->next;
+    }
+
+    entry = slab_alloc(&mt->entries);
+    if (!entry) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    *entry = *m;
+    entry->next = mt->table[index];
+    mt->table[index] = entry;
+}
+
+void midstate_table_remove(MidstateTable *mt, const char *key) {
+    unsigned int index = midstate_hash(key);
+    Midstate *entry = mt->table[index];
+    Midstate *prev = NULL;
+
+    while (entry != NULL) {
+        if (strcmp(entry->key, key) == 0) {
+            if (prev == NULL)
+                mt->table[index] = entry->next;
+            else
+                prev->next = entry->next;
+            slab_free(&mt->entries, entry);
+            return;
+        }
+        prev = entry;
+        entry = entry->next;
+    }
+}
+
+void free_midstate_table(MidstateTable *mt) {
+    slab_destroy(&mt->entries);
+    free(mt);
+}
+
+int midstate_fingerprint(int fd, long long end, unsigned char out[SHA256_DIGEST_LENGTH]) {
+    unsigned char tail[MIDSTATE_TAIL_SIZE];
+    long long start = end > MIDSTATE_TAIL_SIZE ? end - MIDSTATE_TAIL_SIZE : 0;
+    size_t len = (size_t)(end - start);
+
+    // pread does not move the offset the reader is using
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, tail + done, len - done, start + (long long)done);
+        if (n <= 0)
+            return -1;
+        done += (size_t)n;
+    }
+    SHA256(tail, len, out);
+    return 0;
+}
@@ -1,36 +1,110 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
-#include <openssl/sha.h>
+#include <sys/sysmacros.h>
 
 #include "../inc/errExit.h"
 #include "../inc/requestResponse.h"
 #include "../inc/threadPool.h"
 #include "../inc/hashTable.h"
-
-#define BUF_SIZE 8192
+#include "../inc/bufferPool.h"
+#include "../inc/cpuTopology.h"
+#include "../inc/admission.h"
+#include "../inc/slab.h"
+#include "../inc/digest.h"
+#include "../inc/midstateTable.h"
+#include "../inc/chunkIndex.h"
+#include "../inc/fileKey.h"
+
+#define BUF_SIZE (128 * 1024)     // size of a pooled I/O buffer
+#define CHUNK_QUEUE_DEPTH 4         // buffers a reader may run ahead of its hasher
+#define STAGE_QUEUE_CAPACITY 64     // max jobs waiting in front of each stage
+#define HASH_JOBS_PER_SLAB 64
+#define INGEST_BATCH 64             // max requests taken from the server FIFO with one read
 #define NUM_THREAD (sysconf(_SC_NPROCESSORS_ONLN) - 1)
 #define NO_FILE_FOUND "No such file or directory"
+#define SERVER_BUSY "Server busy, retry later"
+#define MIDSTATE_MIN_SIZE (1024 * 1024) // smaller files are always hashed from the start
+#define RESPONSE_RETRY_MS 10        // wait for a client whose FIFO is full before requeueing
+#define RESPONSE_RETRY_PRIORITY 1   // requeued responses go after the new ones
+#define RESPONSE_MAX_RETRIES 1000   // then a client that reads nothing is dropped, even without deadline
+
+// Environment variables to size each stage of the pipeline
+#define ENV_READ_THREADS "SHA256_READ_THREADS"
+#define ENV_HASH_THREADS "SHA256_HASH_THREADS"
+#define ENV_RESPONSE_THREADS "SHA256_RESPONSE_THREADS"
+
+// Environment variable limiting the requests in flight of a single client
+#define ENV_MAX_INFLIGHT "SHA256_MAX_INFLIGHT"
+
+// Environment variables to pin each stage to a CPU list, e.g. "0-3,8"
+#define ENV_READ_CPUS "SHA256_READ_CPUS"
+#define ENV_HASH_CPUS "SHA256_HASH_CPUS"
+#define ENV_RESPONSE_CPUS "SHA256_RESPONSE_CPUS"
 
-char *path2ServerFIFO = "/tmp/fifoServer";
-char *baseClientFIFO = "/tmp/fifoClient";
+char *path2ServerFIFO = SERVER_FIFO;
 
 // The file descriptor entry for the FIFO
 int serverFIFO, serverFIFO_extra;
 
 // Cache for already calculated hashes
 HashTable *cache;
-pthread_mutex_t cacheMutex; // just one thread can access the cache at the same time
+MidstateTable *midstates;   // SHA-256 states to resume hashing of files that grew
+ChunkIndex *chunkIndex;     // content-defined chunks of the files, for deduplication
+pthread_mutex_t cacheMutex; // just one thread can access the caches at the same time
+
+// Pipeline stages: read the file -> hash the chunks -> send the response.
+// The hash stage and the buffers are split per NUMA node: a reader hands its
+// chunks to the hashers of its own node, so the data never crosses sockets.
+ThreadPool readPool, responsePool;
+ThreadPool hashPools[MAX_NUMA_NODES];
+BufferPool bufferPools[MAX_NUMA_NODES];
+int hashNode[MAX_NUMA_NODES];   // node whose hash pool serves each node
+
+// Jobs are recycled: in the steady state a request costs no heap allocation
+SlabCache hashJobCache;
+
+// Requests read from the server FIFO and not yet turned into jobs
+char ingestBuffer[INGEST_BATCH * sizeof(struct Request)];
+
+// State of a request while it moves through the pipeline
+struct HashJob {
+    struct Request request;                     // read straight from the server FIFO
+    int fd;                                     // file being read, -1 if none
+    int status;                                 // RESPONSE_* sent to the client
+    int admitted;                               // counted among the client's requests
+    ChunkQueue chunks;                          // buffers read but not yet hashed
+    BufferPool *buffers;                        // node-local pool the chunks come from
+    unsigned int algorithms;                    // digests asked by the client
+    unsigned int missing;                       // digests not found in the cache
+    char identity[FILE_IDENTITY_SIZE];          // file identity, "" if unknown
+    char inode[FILE_INODE_KEY_SIZE];            // key of the file midstate and chunks, "" if unknown
+    long long offset;                           // first byte read, > 0 when resuming
+    long long size;                             // size in the identity, -1 if unknown
+    int truncated;                              // the reader stopped before the end of file
+    SHA256_CTX midstate;                        // SHA-256 state of the bytes before offset
+    int appendOnly;                             // the client allows resuming from a midstate
+    int chunking;                               // the client asked for the chunks
+    int chunked;                                // chunkList holds all the chunks
+    ChunkList chunkList;                        // content-defined chunks of the file
+    int chunksSent;                             // chunks already written to the client
+    int retries;                                // writes in a row refused, the client FIFO was full
+    char digests[DIGEST_COUNT][DIGEST_HEX_SIZE]; // digests in hex format
+};
 
 void quit(int);                                 // Exit function
-void processRequest(void * );                   // Thread function
-char *SHA256_hashFile(void *);                  // SHA256 processing function
+void readStage(void *);                         // Stage 1: cache lookup and file reading
+void hashStage(void *);                         // Stage 2: digest processing of the chunks
+void responseStage(void *);                     // Stage 3: write the response to the client
 
 // The quit function closes the file descriptors for the FIFO,
 // Removes the FIFO from the file system, and terminates the process
@@ -53,126 +127,600 @@ void quit(int sig) {
     // Free hash table
     if (cache)
         free_hash_table(cache);
+    if (midstates)
+        free_midstate_table(midstates);
+    if (chunkIndex)
+        free_chunk_index(chunkIndex);
 
     // Terminate the process
     _exit(0);
 }
 
-void processRequest(void *requestVoid) {
-    // Retrieve and deallocate the pointer to the request
-    struct Request * request = (struct Request *) requestVoid;
+// Read a thread count from the environment, falling back to `def`
+static int stage_threads(const char *name, long def) {
+    const char *value = getenv(name);
+    long n = value ? strtol(value, NULL, 10) : def;
+    return n < 1 ? 1 : (int)n;
+}
 
-    // Make the path of client's FIFO
-    char path2ClientFIFO [25];
-    sprintf(path2ClientFIFO, "%s%d", baseClientFIFO, request->cPid);
+// Read a CPU list from the environment, return how many CPUs (0 if unset)
+static int stage_cpus(const char *name, int *cpus) {
+    const char *value = getenv(name);
+    if (value == NULL)
+        return 0;
 
-    printf("<Server> Opening FIFO %s...\n", path2ClientFIFO);
-    // Open the client's FIFO in write-only mode
-    int clientFIFO = open(path2ClientFIFO, O_WRONLY);
-    if (clientFIFO == -1) {
-        printf("<Server> Client fifo opening failed");
-        free(request); // Free memory
-        return;
+    int n = parse_cpu_list(value, cpus, MAX_CPUS);
+    if (n <= 0) {
+        fprintf(stderr, "<Server> Ignoring malformed CPU list %s=%s\n", name, value);
+        return 0;
     }
+    return n;
+}
 
-    // Preparing response for the client
-    struct Response response;
+// Create the thread pools of the stages and the node-local buffer pools
+static void init_stages(void) {
+    static int cpus[MAX_CPUS], nodeCpus[MAX_CPUS], hashCpus[MAX_CPUS];
+
+    topology_init();
+    int numNodes = topology_num_nodes();
+
+    // Initialize one thread pool per stage. The reader stage gets more threads
+    // than the CPU-bound hash stage to keep many I/O requests in flight.
+    int numHashThreads = stage_threads(ENV_HASH_THREADS, NUM_THREAD);
+    int numReadThreads = stage_threads(ENV_READ_THREADS, 2 * numHashThreads);
+    int numResponseThreads = stage_threads(ENV_RESPONSE_THREADS, 2);
+    printf("Initializing thread pools: %d read, %d hash, %d response thread on %d NUMA node...\n",
+           numReadThreads, numHashThreads, numResponseThreads, numNodes);
+
+    int n = stage_cpus(ENV_READ_CPUS, cpus);
+    threadpool_init_pinned(&readPool, numReadThreads, STAGE_QUEUE_CAPACITY, cpus, n);
+    n = stage_cpus(ENV_RESPONSE_CPUS, cpus);
+    threadpool_init_pinned(&responsePool, numResponseThreads, STAGE_QUEUE_CAPACITY, cpus, n);
+
+    // Hash CPUs: the configured list, otherwise every CPU of the host.
+    // On a single node without a list the hashers are left unpinned.
+    int numHashCpus = stage_cpus(ENV_HASH_CPUS, cpus);
+    int pinHash = numHashCpus > 0 || numNodes > 1;
+    if (numHashCpus == 0) {
+        for (int node = 0; node < numNodes; node++)
+            numHashCpus += topology_node_cpus(node, cpus + numHashCpus, MAX_CPUS - numHashCpus);
+    }
 
-    // Pointers to the hash string. `hash_to_send` is what we will send to the client.
-    // `newly_created_hash` is the pointer we get from SHA256_hashFile,
-    // which needs to be freed later if it's not from the cache.
-    char *hash_to_send = NULL;
-    char *newly_created_hash = NULL;
+    int firstNode = -1;
+    for (int node = 0; node < numNodes; node++) {
+        hashNode[node] = -1;
+
+        // Hash CPUs that belong to this node
+        int numNodeCpus = topology_node_cpus(node, nodeCpus, MAX_CPUS);
+        int numNodeHashCpus = 0;
+        for (int i = 0; i < numHashCpus; i++) {
+            for (int j = 0; j < numNodeCpus; j++) {
+                if (cpus[i] == nodeCpus[j]) {
+                    hashCpus[numNodeHashCpus++] = cpus[i];
+                    break;
+                }
+            }
+        }
+        if (numNodeHashCpus == 0)
+            continue;
+
+        // Hash threads are shared among the nodes like their CPUs
+        int threads = numHashThreads * numNodeHashCpus / numHashCpus;
+        if (threads < 1)
+            threads = 1;
+        threadpool_init_pinned(&hashPools[node], threads, STAGE_QUEUE_CAPACITY,
+                               hashCpus, pinHash ? numNodeHashCpus : 0);
+        hashNode[node] = node;
+        if (firstNode == -1)
+            firstNode = node;
+    }
+    // No configured CPU exists on this host: one unpinned hash pool
+    if (firstNode == -1) {
+        fprintf(stderr, "<Server> No usable CPU in %s, hash threads are not pinned\n", ENV_HASH_CPUS);
+        threadpool_init_bounded(&hashPools[0], numHashThreads, STAGE_QUEUE_CAPACITY);
+        hashNode[0] = firstNode = 0;
+    }
+    // Nodes without hash CPUs send their chunks to the first node that has them
+    for (int node = 0; node < numNodes; node++) {
+        if (hashNode[node] == -1)
+            hashNode[node] = firstNode;
+    }
+
+    // Allocate the buffers of each node from one of its CPUs, so that the
+    // first touch places the pages in its local memory. A reader takes buffers
+    // only once a hasher works on its job, and a job holds at most a full
+    // chunk queue plus the buffer in the reader's hands and the one being
+    // hashed. Any reader can land on any node, but the jobs filling a node's
+    // buffers are bounded by the threads of the hash pool serving it too:
+    // with that many buffers per job, readers never wait for buffers.
+    for (int node = 0; node < numNodes; node++) {
+        int jobs = hashPools[hashNode[node]].num_threads;
+        if (jobs > numReadThreads)
+            jobs = numReadThreads;
+        n = topology_node_cpus(node, nodeCpus, MAX_CPUS);
+        if (numNodes > 1)
+            topology_bind_current_thread(nodeCpus, n);
+        bufferpool_init(&bufferPools[node], jobs * (CHUNK_QUEUE_DEPTH + 2), BUF_SIZE);
+    }
+    if (numNodes > 1)
+        topology_bind_current_thread(NULL, 0);
+}
+
+// Identity of a file content: the cached digests of a path become stale
+// as soon as the file is replaced or modified
+static void file_identity(char *identity, dev_t dev, ino_t ino, long long size,
+                          long long mtimeSec, long mtimeNsec) {
+    snprintf(identity, FILE_IDENTITY_SIZE, "%u.%u:%llu:%lld:%lld.%09ld",
+             major(dev), minor(dev), (unsigned long long)ino, size, mtimeSec, mtimeNsec);
+}
+
+// Key of a file whatever its content, for the midstates and the chunk index
+static void file_inode(char *inode, dev_t dev, ino_t ino) {
+    snprintf(inode, FILE_INODE_KEY_SIZE, "%u.%u:%llu", major(dev), minor(dev), (unsigned long long)ino);
+}
+
+// The cache is keyed on (file identity, algorithm)
+static void cache_key(char *key, const char *identity, int algo) {
+    snprintf(key, MAX_KEY_SIZE, "%s:%s", identity, digest_name(algo));
+}
+
+// If only SHA-256 is missing and the file only grew since its midstate was
+// saved, start hashing from the midstate reading just the new bytes. The
+// fingerprint of the tail detects files rewritten instead of appended, but
+// not an edit before the tail: only the client knows the file is append-only.
+static void try_resume(struct HashJob *job, const struct stat *st) {
+    Midstate m;
+
+    if (!job->appendOnly)
+        return;
+    if (job->missing != DIGEST_BIT(DIGEST_SHA256) || job->inode[0] == '\0')
+        return;
+    // Chunk boundaries are found reading the file from the start
+    if (job->chunking && !job->chunked)
+        return;
 
-    // Lock the mutex before accessing the shared cache
     pthread_mutex_lock(&cacheMutex);
-    char *cachedHash = hash_table_get(cache, request->fileName);
+    int found = midstate_table_get(midstates, job->inode, &m) == 0;
+    pthread_mutex_unlock(&cacheMutex);
+    if (!found || m.length > st->st_size)
+        return;
+
+    unsigned char tail[SHA256_DIGEST_LENGTH];
+    if (midstate_fingerprint(job->fd, m.length, tail) != 0 ||
+        memcmp(tail, m.tail, SHA256_DIGEST_LENGTH) != 0)
+        return;
+
+    if (lseek(job->fd, m.length, SEEK_SET) != m.length)
+        return;
+    job->midstate = m.ctx;
+    job->offset = m.length;
+    printf("<Server> Resuming SHA256 of '%s' from byte %lld\n", job->request.fileName, m.length);
+}
+
+void readStage(void *jobVoid) {
+    struct HashJob *job = (struct HashJob *) jobVoid;
+    struct Request *request = &job->request;
+
+    // The client already gave up while the request was queued
+    if (deadline_expired(request->deadline)) {
+        threadpool_add_job_priority(&responsePool, responseStage, job, 0);
+        return;
+    }
 
-    if (cachedHash) {
-        hash_to_send = cachedHash;
+    // Lock the mutex before accessing the shared cache
+    job->missing = job->algorithms;
+    if (job->identity[0] != '\0') {
+        char key[MAX_KEY_SIZE];
+        pthread_mutex_lock(&cacheMutex);
+        for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+            if (!(job->algorithms & DIGEST_BIT(algo)))
+                continue;
+            cache_key(key, job->identity, algo);
+            char *cachedHash = hash_table_get(cache, key);
+            if (cachedHash) {
+                strcpy(job->digests[algo], cachedHash);
+                job->missing &= ~DIGEST_BIT(algo);
+            }
+        }
+        if (job->chunking)
+            job->chunked = chunk_index_get_file(chunkIndex, job->inode, job->identity, &job->chunkList) == 0;
+        pthread_mutex_unlock(&cacheMutex);
+    }
+
+    if (job->missing == 0 && (!job->chunking || job->chunked)) {
+        job->status = RESPONSE_OK;
         printf("<Server> Cache hit for file '%s'!\n", request->fileName);
+        threadpool_add_job_priority(&responsePool, responseStage, job, 0);
+        return;
+    }
+
+    job->fd = open(request->fileName, O_RDONLY);
+    if (job->fd == -1) {
+        perror("Error during file opening");
+        threadpool_add_job_priority(&responsePool, responseStage, job, 0);
+        return;
+    }
+
+    // The digests are cached under the identity of the content actually read
+    struct stat st;
+    job->offset = 0;
+    job->size = -1;
+    if (fstat(job->fd, &st) == 0) {
+        job->size = (long long)st.st_size;
+        file_identity(job->identity, st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+        file_inode(job->inode, st.st_dev, st.st_ino);
+        try_resume(job, &st);
     } else {
-        // Cache miss: unlock the mutex while performing the long-running hash calculation
-        pthread_mutex_unlock(&cacheMutex);
-        newly_created_hash = SHA256_hashFile(request->fileName);
+        job->identity[0] = '\0';
+        job->inode[0] = '\0';
+    }
 
-        //  sleep(20);
+    sleep(5); // stop to accumulate jobs (file to hash)
 
-        // Re-lock the mutex to update the cache and prepare the response
+    // Hand the job to the hash stage, then keep feeding it with chunks.
+    // The chunk queue is bounded, so a slow hasher throttles this reader.
+    chunkqueue_init(&job->chunks, CHUNK_QUEUE_DEPTH);
+    job->status = RESPONSE_OK;
+    int node = topology_current_node();
+    job->buffers = &bufferPools[node];
+    threadpool_add_job_priority(&hashPools[hashNode[node]], hashStage, job, request->fileSize);
+
+    // Buffers held for a job still queued for hashing could starve the
+    // readers of the jobs being hashed: wait for a hasher first
+    chunkqueue_wait_started(&job->chunks);
+
+    Buffer *buf;
+    job->truncated = 0;
+    long long position = job->offset;
+    do {
+        buf = bufferpool_get(job->buffers);
+        // Stop reading as soon as the client gave up, the digest of what was
+        // read must not be cached
+        ssize_t bytesRead;
+        if (deadline_expired(request->deadline)) {
+            job->truncated = 1;
+            bytesRead = 0;
+        } else {
+            // Bytes appended while reading are not part of the identity the
+            // digest is cached under: stop at its size
+            size_t want = job->buffers->buf_size;
+            if (job->size >= 0 && job->size - position < (long long)want)
+                want = (size_t)(job->size - position);
+            bytesRead = want > 0 ? read(job->fd, buf->data, want) : 0;
+        }
+        if (bytesRead == -1) {
+            perror("Error during file reading");
+            job->status = RESPONSE_NOT_FOUND;
+            bytesRead = 0;
+        }
+        position += bytesRead;
+        // The file shrank while reading: the digest matches no identity
+        if (bytesRead == 0 && job->size >= 0 && position < job->size)
+            job->truncated = 1;
+        buf->len = (size_t)bytesRead;
+        chunkqueue_push(&job->chunks, buf); // an empty buffer marks the end of file
+    } while (buf->len > 0);
+}
+
+void hashStage(void *jobVoid) {
+    struct HashJob *job = (struct HashJob *) jobVoid;
+    char digests[DIGEST_COUNT][DIGEST_HEX_SIZE];
+    DigestCtx ctx;
+
+    // SHA-256 midstate at the last block boundary, saved for the next request
+    int saveMidstate = (job->missing & DIGEST_BIT(DIGEST_SHA256)) != 0;
+    Midstate m;
+    m.length = 0;
+
+    // All the missing digests are computed in a single pass over the data,
+    // the same pass splits it in chunks if they are not in the index
+    int digesting = job->missing != 0;
+    int chunking = job->chunking && !job->chunked;
+    Chunker chunker;
+    if (chunking)
+        chunker_init(&chunker);
+    int ok = !digesting || digest_init(&ctx, job->missing) == 0;
+    if (ok && digesting && job->offset > 0)
+        digest_resume_sha256(&ctx, &job->midstate);
+
+    // From now on the reader may take buffers for this job
+    chunkqueue_start(&job->chunks);
+
+    long long hashed = job->offset;
+    int skipped = 0;    // buffers given back without hashing them
+    Buffer *buf;
+    while ((buf = chunkqueue_pop(&job->chunks))->len > 0) {
+        // Once the deadline is passed just give the buffers back
+        if (ok && !skipped && deadline_expired(job->request.deadline))
+            skipped = 1;
+        if (ok && !skipped) {
+            // Split the chunk at the last block boundary to save the midstate there
+            long long boundary = (hashed + (long long)buf->len) & ~(long long)(SHA256_CBLOCK - 1);
+            if (saveMidstate && boundary > hashed) {
+                size_t aligned = (size_t)(boundary - hashed);
+                digest_update(&ctx, buf->data, aligned);
+                digest_sha256_midstate(&ctx, &m.ctx);
+                m.length = boundary;
+                digest_update(&ctx, buf->data + aligned, buf->len - aligned);
+            } else if (digesting) {
+                digest_update(&ctx, buf->data, buf->len);
+            }
+            if (chunking)
+                chunker_update(&chunker, buf->data, buf->len, &job->chunkList);
+        }
+        hashed += buf->len;
+        bufferpool_put(job->buffers, buf);
+    }
+    bufferpool_put(job->buffers, buf);
+    if (ok && digesting)
+        digest_final(&ctx, digests);
+    else if (!ok)
+        job->status = RESPONSE_NOT_FOUND;
+    if (chunking)
+        chunker_final(&chunker, &job->chunkList);
+
+    // The reader set `truncated` before pushing the end of file: the digests
+    // cover the whole file only if neither stage stopped early
+    int complete = !job->truncated && !skipped;
+    if (!complete)
+        job->status = RESPONSE_NOT_FOUND;
+
+    // Save the midstate of big files with the fingerprint of the bytes before it
+    if (ok && saveMidstate && job->status == RESPONSE_OK && job->inode[0] != '\0' &&
+        m.length >= MIDSTATE_MIN_SIZE &&
+        midstate_fingerprint(job->fd, m.length, m.tail) == 0) {
+        strcpy(m.key, job->inode);
         pthread_mutex_lock(&cacheMutex);
+        midstate_table_put(midstates, &m);
+        pthread_mutex_unlock(&cacheMutex);
+    }
 
-        if (newly_created_hash) {
-            // Successfully created a new hash. Insert a copy into the cache.
-            hash_table_insert(cache, request->fileName, newly_created_hash);
-            hash_to_send = newly_created_hash;
-        } else {
-            // File not found or error
-            hash_to_send = (char *)NO_FILE_FOUND;
+    // The reader pushed its last buffer: nobody else touches the file now
+    chunkqueue_destroy(&job->chunks);
+    close(job->fd);
+    job->fd = -1;
+
+    // The digest of part of the file is never cached nor sent
+    if (job->status == RESPONSE_OK) {
+        char key[MAX_KEY_SIZE];
+        pthread_mutex_lock(&cacheMutex);
+        for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+            if (!(job->missing & DIGEST_BIT(algo)))
+                continue;
+            strcpy(job->digests[algo], digests[algo]);
+            printf("<Server> Thread [%lu] - %s Digest generation of path '%s':\n<Server> Digest created: %s\n",
+                   pthread_self(), digest_name(algo), job->request.fileName, job->digests[algo]);
+            if (job->identity[0] != '\0') {
+                cache_key(key, job->identity, algo);
+                hash_table_insert(cache, key, job->digests[algo]);
+            }
         }
+        if (chunking) {
+            printf("<Server> Thread [%lu] - %d chunks in path '%s'\n",
+                   pthread_self(), job->chunkList.count, job->request.fileName);
+            if (job->identity[0] != '\0' && job->inode[0] != '\0')
+                chunk_index_put_file(chunkIndex, job->inode, job->identity, &job->chunkList);
+            job->chunked = 1;
+        }
+        pthread_mutex_unlock(&cacheMutex);
     }
-    pthread_mutex_unlock(&cacheMutex);
 
-    // Copy the hash to the response
-    strcpy(response.hashCode, hash_to_send);
+    threadpool_add_job_priority(&responsePool, responseStage, job, 0);
+}
+
+// Free a job that left the pipeline
+static void release_job(struct HashJob *job) {
+    if (job->admitted)
+        admission_release(job->request.cPid, job->request.sessionId);
+    chunklist_free(&job->chunkList);
+    slab_free(&hashJobCache, job);
+}
+
+void responseStage(void *jobVoid) {
+    struct HashJob *job = (struct HashJob *) jobVoid;
+    struct Request *request = &job->request;
 
-    // If we created a new hash, we must free the memory after copying it to the response.
-    // If it was a cache hit, hash_to_send points to memory owned by the hash table,
-    // which should not be freed here.
-    if (newly_created_hash) {
-        free(newly_created_hash);
+    // Nobody is waiting for the response anymore
+    if (deadline_expired(request->deadline)) {
+        printf("<Server> Deadline expired, dropping request for '%s'\n", request->fileName);
+        release_job(job);
+        return;
     }
 
-    // Write response into the client FIFO
-    if (write(clientFIFO, &response, sizeof(struct Response)) != sizeof(struct Response))
-        printf("<Server> Server fifo writing failed\n");
+    // Make the path of client's FIFO
+    char path2ClientFIFO [CLIENT_FIFO_SIZE];
+    snprintf(path2ClientFIFO, CLIENT_FIFO_SIZE, CLIENT_FIFO_FORMAT, request->cPid, request->sessionId);
+
+    if (job->retries == 0)
+        printf("<Server> Opening FIFO %s...\n", path2ClientFIFO);
+    // Open the client's FIFO in write-only mode. The client keeps it open for
+    // reading while it waits: if nobody reads it the client is gone, so the
+    // open must fail instead of blocking a response thread forever.
+    // The writes do not block either: a client that stops reading must not
+    // hold a response thread, and through the bounded queues stall the
+    // requests of every other client.
+    int clientFIFO = open(path2ClientFIFO, O_WRONLY | O_NONBLOCK);
+    if (clientFIFO == -1) {
+        printf("<Server> Client fifo opening failed\n");
+        release_job(job);
+        return;
+    }
+
+    // Preparing response for the client
+    struct Response response;
+    memset(&response, 0, sizeof(struct Response));
+    response.requestId = request->requestId;
+    response.status = job->status;
+    if (job->status == RESPONSE_OK) {
+        // hashCode holds the first digest asked, `digests` all of them
+        response.algorithms = job->algorithms;
+        int first = -1;
+        for (int algo = 0; algo < DIGEST_COUNT; algo++) {
+            if (!(job->algorithms & DIGEST_BIT(algo)))
+                continue;
+            strcpy(response.digests[algo], job->digests[algo]);
+            if (first == -1)
+                first = algo;
+        }
+        strcpy(response.hashCode, job->digests[first]);
+    } else if (job->status == RESPONSE_BUSY)
+        strcpy(response.hashCode, SERVER_BUSY);
+    else
+        strcpy(response.hashCode, NO_FILE_FOUND);
+
+    // The chunks go in batches: every response but the last has `more`
+    // set. A response is below PIPE_BUF, so the responses of different
+    // requests of the session never interleave, and a write sends all of
+    // it or nothing. job->chunksSent survives a retry.
+    int numChunks = job->status == RESPONSE_OK && job->chunked ? job->chunkList.count : 0;
+    for (;;) {
+        int n = numChunks - job->chunksSent < CHUNKS_PER_RESPONSE ?
+                numChunks - job->chunksSent : CHUNKS_PER_RESPONSE;
+        response.numChunks = n;
+        response.more = job->chunksSent + n < numChunks;
+        if (n > 0) {
+            memcpy(response.chunks, job->chunkList.chunks + job->chunksSent, sizeof(struct ChunkInfo) * n);
+            pthread_mutex_lock(&cacheMutex);
+            for (int i = 0; i < n; i++)
+                response.chunks[i].occurrences = chunk_index_occurrences(chunkIndex, response.chunks[i].digest);
+            pthread_mutex_unlock(&cacheMutex);
+        }
+
+        // Free the client's slot before it can read the final response:
+        // a client sends its next request as soon as it gets the answer
+        if (!response.more && job->admitted) {
+            admission_release(request->cPid, request->sessionId);
+            job->admitted = 0;
+        }
+
+        // Write response into the client FIFO
+        ssize_t bW = write(clientFIFO, &response, sizeof(struct Response));
+        if (bW == -1 && errno == EAGAIN) {
+            // The FIFO is full: give the client a moment to read, then let
+            // the other responses go first. If the queue is full keep
+            // trying here, the client's deadline or the retry limit bounds
+            // the wait.
+            struct pollfd pfd = { clientFIFO, POLLOUT, 0 };
+            poll(&pfd, 1, RESPONSE_RETRY_MS);
+            if (deadline_expired(request->deadline)) {
+                printf("<Server> Deadline expired, dropping request for '%s'\n", request->fileName);
+                break;
+            }
+            if (++job->retries > RESPONSE_MAX_RETRIES) {
+                printf("<Server> Client not reading, dropping request for '%s'\n", request->fileName);
+                break;
+            }
+            if (threadpool_try_add_job_priority(&responsePool, responseStage, job, RESPONSE_RETRY_PRIORITY) == 0) {
+                close(clientFIFO);
+                return;
+            }
+            continue;
+        }
+        if (bW != sizeof(struct Response)) {
+            printf("<Server> Server fifo writing failed\n");
+            break;
+        }
+        job->chunksSent += n;
+        job->retries = 0;
+        if (!response.more)
+            break;
+    }
 
     // Close FIFO
     if (close(clientFIFO) != 0)
         printf("<Server> close failed");
 
-    free(request);
+    release_job(job);
 }
 
-char *SHA256_hashFile(void *arg) {
-    char *filename = (char *)arg;
-    FILE *file = fopen(filename, "rb");
+// Shed the load: the response stage tells the client to retry
+static void reject_job(struct HashJob *job, int task_id) {
+    printf("<Server> Server busy, rejecting request (task_id=%d)\n", task_id);
+    job->status = RESPONSE_BUSY;
+    if (threadpool_try_add_job_priority(&responsePool, responseStage, job, 0) != 0)
+        release_job(job);
+}
 
-    if (!file) {
-        perror("Error during file opening");
-        return NULL;
+// Turn `n` requests read from the server FIFO into jobs. Admission control
+// drops the requests whose client already gave up and answers "busy" when
+// a client has too many requests in flight or the read stage is full.
+// The admitted requests enter the read stage with a single locked insert.
+static void ingest_batch(const char *data, int n, int *task_id) {
+    struct HashJob *jobs[INGEST_BATCH];
+    void *args[INGEST_BATCH];
+    long long priorities[INGEST_BATCH];
+    int taskIds[INGEST_BATCH];
+    int admitted = 0;
+
+    for (int i = 0; i < n; i++, (*task_id)++) {
+        struct HashJob *job = (struct HashJob *)slab_alloc(&hashJobCache);
+        if (job == NULL) {
+            perror("Request allocation failed");
+            continue;
+        }
+        struct Request *request = &job->request;
+        memcpy(request, data + i * sizeof(struct Request), sizeof(struct Request));
+        request->fileName[MAX_FILENAME_SIZE - 1] = '\0';
+        job->fd = -1;
+        job->status = RESPONSE_NOT_FOUND;
+        job->admitted = 0;
+        job->appendOnly = (request->algorithms & REQUEST_APPEND_ONLY) != 0;
+        job->chunking = (request->algorithms & REQUEST_CHUNKS) != 0;
+        job->chunked = 0;
+        job->chunksSent = 0;
+        job->retries = 0;
+        chunklist_init(&job->chunkList);
+        job->algorithms = request->algorithms & DIGEST_ALL;
+        if (job->algorithms == 0)
+            job->algorithms = DIGEST_BIT(DIGEST_SHA256);
+
+        if (deadline_expired(request->deadline)) {
+            printf("<Server> Request expired before admission (task_id=%d)\n", *task_id);
+            release_job(job);
+        } else if (admission_acquire(request->cPid, request->sessionId) != 0) {
+            reject_job(job, *task_id);
+        } else {
+            job->admitted = 1;
+            taskIds[admitted] = *task_id;
+            jobs[admitted++] = job;
+        }
     }
 
-    sleep(5); // stop to accumulate jobs (file to hash)
-
-    unsigned char buffer[BUF_SIZE];
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-
-    SHA256_Init(&sha256);
-    size_t bytesRead;
-    while ((bytesRead = fread(buffer, 1, BUF_SIZE, file)) > 0) {
-        SHA256_Update(&sha256, buffer, bytesRead);
+    // get fileSize of the admitted requests, it is their priority in the queues,
+    // and the identity of the file for the cache lookup. statx asks only for
+    // these fields, without syncing with remote file systems
+    for (int i = 0; i < admitted; i++) {
+        struct Request *request = &jobs[i]->request;
+        struct statx stx;
+        if (statx(AT_FDCWD, request->fileName, AT_STATX_DONT_SYNC,
+                  STATX_SIZE | STATX_INO | STATX_MTIME, &stx) == 0) {
+            request->fileSize = (long long)stx.stx_size;
+            dev_t dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            file_identity(jobs[i]->identity, dev, stx.stx_ino,
+                          request->fileSize, stx.stx_mtime.tv_sec, stx.stx_mtime.tv_nsec);
+            file_inode(jobs[i]->inode, dev, stx.stx_ino);
+        } else {
+            request->fileSize = -1; // ErrorValue
+            jobs[i]->identity[0] = '\0';
+            jobs[i]->inode[0] = '\0';
+        }
+        args[i] = jobs[i];
+        priorities[i] = request->fileSize;
     }
-    SHA256_Final(hash, &sha256);
-    fclose(file);
 
-    // Allocate the digest in a dynamic memory space, so we can manage it outside of this function
-    char *hashStr = malloc(SHA256_DIGEST_LENGTH * 2 + 1);
-    if (!hashStr) return NULL;
+    int added = threadpool_try_add_jobs(&readPool, readStage, args, priorities, admitted);
+    if (added > 0)
+        printf("<Server> Forward %d request to the read stage...\n", added);
 
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        sprintf(hashStr + (i * 2), "%02x", hash[i]);
+    // The read queue is full: the rest of the batch is rejected
+    for (int i = added; i < admitted; i++) {
+        admission_release(jobs[i]->request.cPid, jobs[i]->request.sessionId);
+        jobs[i]->admitted = 0;
+        reject_job(jobs[i], taskIds[i]);
     }
-    hashStr[SHA256_DIGEST_LENGTH * 2] = '\0';
-
-    printf("<Server> Thread [%lu] - SHA256 Digest generation of path '%s':\n<Server> Digest created: %s\n",
-           pthread_self(), filename, hashStr);
-
-    return hashStr;
 }
 
 int main(int argc, char *argv[]) {
-    ThreadPool my_pool;
     int task_id = 1;
 
     printf("<Server> Starting server...\n");
@@ -193,12 +741,19 @@ int main(int argc, char *argv[]) {
         signal(SIGINT, quit) == SIG_ERR)
     { errExit("Signal handlers setting failed"); }
 
-    // Initialize thread pool
-    printf("Initializing thread pool with %ld thread...\n", NUM_THREAD);
-    threadpool_init(&my_pool, NUM_THREAD);
+    // A client that closes its FIFO while we answer must not kill the server
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+        errExit("Signal handlers setting failed");
+
+    // Initialize the thread pools of the pipeline
+    init_stages();
+    slab_init(&hashJobCache, sizeof(struct HashJob), HASH_JOBS_PER_SLAB);
+    admission_init(stage_threads(ENV_MAX_INFLIGHT, DEFAULT_MAX_INFLIGHT));
 
     // Hash table creation
     cache = create_hash_table();
+    midstates = create_midstate_table();
+    chunkIndex = create_chunk_index();
     // Initialize cache mutex
     if (pthread_mutex_init(&cacheMutex, NULL) != 0) {
         errExit("Mutex init failed");
@@ -219,48 +774,41 @@ int main(int argc, char *argv[]) {
     if (serverFIFO_extra == -1)
         errExit("Write-only server fifo opening failed");
 
-    struct Request *request;
+    // Read as many requests as the FIFO holds with one read(). A client writes
+    // a request atomically, but a read can still end in the middle of one:
+    // its first bytes are kept at the start of the buffer for the next read
+    size_t pending = 0;
     int bR = -1;
     do {
         printf("<Server> Waiting for a request...\n");
 
-        // Dynamic allocation of an empty request
-        request = (struct Request *)malloc(sizeof(struct Request));
-        if (request == NULL) {
-            perror("Request allocation failed");
-            continue;
-        }
-
-        // Read a request from the FIFO and put it in request in heap memory
-        // This is necessary because otherwise if we keep request in the stack the do-while loop constantly changes it
-        // In this way each time a new request is allocated in the heap
-        bR = read(serverFIFO, request, sizeof(struct Request));
+        bR = read(serverFIFO, ingestBuffer + pending, sizeof(ingestBuffer) - pending);
 
         // Check the number of bytes read from the FIFO
         if (bR == -1) {
             printf("<Server> Something went wrong while reading request (task_id=%d)\n", task_id);
-            free(request);
-        } else if (bR != sizeof(struct Request) || bR == 0) {
+        } else if (bR == 0) {
             printf("<Server> Bad request received (task_id=%d)\n", task_id);
-            free(request);
         } else {
-            printf("<Server> Forward request to a separate thread (task_id=%d)...\n", task_id);
-
-            // get fileSize and insert the value in the relative request
-            struct stat st;
-            if (stat(request->fileName, &st) == 0) {
-                request->fileSize = st.st_size;
-            } else {
-                request->fileSize = -1; // ErrorValue
-            }
+            pending += bR;
+            int n = pending / sizeof(struct Request);
+            ingest_batch(ingestBuffer, n, &task_id);
 
-            threadpool_add_job(&my_pool, processRequest, request);
+            size_t used = n * sizeof(struct Request);
+            memmove(ingestBuffer, ingestBuffer + used, pending - used);
+            pending -= used;
         }
-        task_id++;
     } while (bR != -1);
 
-    threadpool_wait(&my_pool);
-    threadpool_destroy(&my_pool);
+    // Drain the stages in pipeline order
+    threadpool_destroy(&readPool);
+    for (int node = 0; node < topology_num_nodes(); node++) {
+        if (hashNode[node] == node)
+            threadpool_destroy(&hashPools[node]);
+    }
+    threadpool_destroy(&responsePool);
+    for (int node = 0; node < topology_num_nodes(); node++)
+        bufferpool_destroy(&bufferPools[node]);
     pthread_mutex_destroy(&cacheMutex); // Distruggi il mutex prima di uscire
     quit(0);
     return 0;
@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../inc/sha256Client.h"
+#include "../inc/slab.h"
+
+#define PENDING_BUCKETS 1024
+#define PENDING_PER_SLAB 256
+#define RESPONSE_BATCH 16           // responses taken from the client FIFO with one read
+#define BUSY_RETRY_MS 100           // pause of the sending after the server answered busy
+
+// A request submitted and not completed yet
+typedef struct Pending {
+    struct Request request;
+    Sha256Callback callback;
+    void *userData;
+    int sent;                       // written to the server FIFO
+    int timeoutMs;                  // the deadline is set when the request is sent
+    struct Response response;       // filled when completed
+    struct Pending *next;           // chain of the bucket
+    struct Pending *queued;         // send queue, or list of the completed requests
+} Pending;
+
+struct Sha256Session {
+    unsigned int id;
+    char path[CLIENT_FIFO_SIZE];
+    int serverFIFO;
+    int clientFIFO;
+    int clientFIFO_extra;           // keeps a writer open: the client FIFO never sees EOF
+    unsigned int nextRequestId;
+    int window;
+    int inflight;                   // sent and not answered
+    int pending;                    // not completed
+    Pending *table[PENDING_BUCKETS];
+    Pending *queueFront;            // waiting for a slot in the window
+    Pending *queueRear;
+    long long retryAt;              // nothing is sent before, the server was busy
+    char readBuffer[RESPONSE_BATCH * sizeof(struct Response)];
+    size_t readPending;             // bytes of an incomplete response
+    SlabCache entries;
+    pthread_mutex_t mutex;
+};
+
+static unsigned int nextSessionId = 0;
+static pthread_mutex_t sessionIdMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Wall clock in milliseconds, the deadlines are compared by the server too
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+Sha256Session *sha256_session_open(void) {
+    Sha256Session *session = calloc(1, sizeof(Sha256Session));
+    if (session == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&sessionIdMutex);
+    session->id = nextSessionId++;
+    pthread_mutex_unlock(&sessionIdMutex);
+
+    session->serverFIFO = session->clientFIFO = session->clientFIFO_extra = -1;
+    session->nextRequestId = 1;
+    session->window = SHA256_DEFAULT_WINDOW;
+    snprintf(session->path, CLIENT_FIFO_SIZE, CLIENT_FIFO_FORMAT, getpid(), session->id);
+
+    // The client FIFO is open for reading before any request is sent, so the
+    // server can always deliver the response
+    unlink(session->path);
+    if (mkfifo(session->path, S_IRUSR | S_IWUSR | S_IWGRP) == -1) {
+        free(session);
+        return NULL;
+    }
+    session->clientFIFO = open(session->path, O_RDONLY | O_NONBLOCK);
+    if (session->clientFIFO != -1)
+        session->clientFIFO_extra = open(session->path, O_WRONLY);
+
+    // Fails with ENXIO if the server is not running
+    if (session->clientFIFO_extra != -1)
+        session->serverFIFO = open(SERVER_FIFO, O_WRONLY | O_NONBLOCK);
+
+    if (session->serverFIFO == -1) {
+        int err = errno;
+        if (session->clientFIFO_extra != -1)
+            close(session->clientFIFO_extra);
+        if (session->clientFIFO != -1)
+            close(session->clientFIFO);
+        unlink(session->path);
+        free(session);
+        errno = err;
+        return NULL;
+    }
+
+    slab_init(&session->entries, sizeof(Pending), PENDING_PER_SLAB);
+    pthread_mutex_init(&session->mutex, NULL);
+    return session;
+}
+
+void sha256_session_close(Sha256Session *session) {
+    if (session == NULL)
+        return;
+
+    close(session->serverFIFO);
+    close(session->clientFIFO_extra);
+    close(session->clientFIFO);
+    unlink(session->path);
+
+    slab_destroy(&session->entries);
+    pthread_mutex_destroy(&session->mutex);
+    free(session);
+}
+
+void sha256_session_set_window(Sha256Session *session, int window) {
+    pthread_mutex_lock(&session->mutex);
+    session->window = window < 1 ? 1 : window;
+    pthread_mutex_unlock(&session->mutex);
+}
+
+int sha256_pending(Sha256Session *session) {
+    pthread_mutex_lock(&session->mutex);
+    int pending = session->pending;
+    pthread_mutex_unlock(&session->mutex);
+    return pending;
+}
+
+int sha256_session_fd(Sha256Session *session) {
+    return session->clientFIFO;
+}
+
+// Write to the server FIFO with SIGPIPE blocked: if the server is gone the
+// write fails with EPIPE instead of killing the process using the library
+static ssize_t write_server(Sha256Session *session, const void *data, size_t len) {
+    sigset_t pipeSet, oldSet, pendingSet;
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+
+    // A SIGPIPE already pending was not raised by us: leave it to the caller
+    sigpending(&pendingSet);
+    int wasPending = sigismember(&pendingSet, SIGPIPE);
+
+    ssize_t n = write(session->serverFIFO, data, len);
+    if (n == -1 && errno == EPIPE && !wasPending) {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipeSet, NULL, &zero);
+        errno = EPIPE;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &oldSet, NULL);
+    return n;
+}
+
+// Send the queued requests while the window has room, called with the mutex
+// locked. Return -1 if the server is gone
+static int flush_queue(Sha256Session *session) {
+    if (session->retryAt > now_ms())
+        return 0;
+
+    while (session->queueFront != NULL && session->inflight < session->window) {
+        Pending *p = session->queueFront;
+
+        // The time a request waits in the queue does not count against it
+        long long deadline = p->request.deadline;
+        if (deadline == 0)
+            p->request.deadline = now_ms() + p->timeoutMs;
+
+        // A request is smaller than PIPE_BUF: it is written entirely or not at all
+        if (write_server(session, &p->request, sizeof(struct Request)) != sizeof(struct Request)) {
+            p->request.deadline = deadline;
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        p->sent = 1;
+        session->inflight++;
+        session->queueFront = p->queued;
+        if (session->queueFront == NULL)
+            session->queueRear = NULL;
+        p->queued = NULL;
+    }
+    return 0;
+}
+
+// Request of the table, called with the mutex locked
+static Pending *find_pending(Sha256Session *session, unsigned int requestId) {
+    Pending *p = session->table[requestId % PENDING_BUCKETS];
+    while (p != NULL && p->request.requestId != requestId)
+        p = p->next;
+    return p;
+}
+
+// Remove a request from the table, called with the mutex locked
+static Pending *take_pending(Sha256Session *session, unsigned int requestId) {
+    Pending **link = &session->table[requestId % PENDING_BUCKETS];
+    while (*link != NULL) {
+        Pending *p = *link;
+        if (p->request.requestId == requestId) {
+            *link = p->next;
+            session->pending--;
+            if (p->sent)
+                session->inflight--;
+            return p;
+        }
+        link = &p->next;
+    }
+    return NULL;
+}
+
+unsigned int sha256_submit(Sha256Session *session, const char *path, unsigned int algorithms,
+                           int timeoutMs, Sha256Callback callback, void *userData) {
+    if (strlen(path) >= MAX_FILENAME_SIZE) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+
+    Pending *p = slab_alloc(&session->entries);
+    if (p == NULL)
+        return 0;
+    memset(&p->request, 0, sizeof(struct Request));
+    p->request.cPid = getpid();
+    p->request.sessionId = session->id;
+    strcpy(p->request.fileName, path);
+    p->request.algorithms = algorithms;
+    p->timeoutMs = timeoutMs > 0 ? timeoutMs : SHA256_DEFAULT_TIMEOUT_MS;
+    p->callback = callback;
+    p->userData = userData;
+    p->sent = 0;
+    p->queued = NULL;
+
+    pthread_mutex_lock(&session->mutex);
+    // 0 is the error value
+    if (session->nextRequestId == 0)
+        session->nextRequestId = 1;
+    p->request.requestId = session->nextRequestId++;
+
+    unsigned int bucket = p->request.requestId % PENDING_BUCKETS;
+    p->next = session->table[bucket];
+    session->table[bucket] = p;
+    session->pending++;
+
+    if (session->queueRear == NULL)
+        session->queueFront = p;
+    else
+        session->queueRear->queued = p;
+    session->queueRear = p;
+
+    int rc = flush_queue(session);
+    unsigned int requestId = p->request.requestId;
+    if (rc != 0) {
+        // The server is gone: the request can never be answered
+        take_pending(session, requestId);
+        Pending **link = &session->queueFront;
+        Pending *last = NULL;
+        while (*link != NULL && *link != p) {
+            last = *link;
+            link = &(*link)->queued;
+        }
+        if (*link == p) {
+            *link = p->queued;
+            if (session->queueRear == p)
+                session->queueRear = last;
+        }
+        requestId = 0;
+    }
+    pthread_mutex_unlock(&session->mutex);
+
+    if (requestId == 0)
+        slab_free(&session->entries, p);
+    return requestId;
+}
+
+// Put back at the front of the send queue a request rejected because the
+// server was busy, called with the mutex locked. It keeps its deadline
+static void requeue_busy(Sha256Session *session, Pending *p) {
+    p->sent = 0;
+    session->inflight--;
+    p->queued = session->queueFront;
+    session->queueFront = p;
+    if (session->queueRear == NULL)
+        session->queueRear = p;
+    session->retryAt = now_ms() + BUSY_RETRY_MS;
+}
+
+// Read the available responses and move the answered requests to `done`,
+// called with the mutex locked
+static void read_responses(Sha256Session *session, Pending **done) {
+    ssize_t bR;
+    while ((bR = read(session->clientFIFO, session->readBuffer + session->readPending,
+                      sizeof(session->readBuffer) - session->readPending)) > 0) {
+        session->readPending += (size_t)bR;
+        size_t n = session->readPending / sizeof(struct Response);
+
+        for (size_t i = 0; i < n; i++) {
+            struct Response response;
+            memcpy(&response, session->readBuffer + i * sizeof(struct Response), sizeof(struct Response));
+
+            // A batch of chunks: the request stays pending, its callback
+            // gets a copy of the response
+            if (response.more) {
+                Pending *p = find_pending(session, response.requestId);
+                Pending *copy = p != NULL ? slab_alloc(&session->entries) : NULL;
+                if (copy != NULL) {
+                    *copy = *p;
+                    copy->response = response;
+                    copy->queued = *done;
+                    *done = copy;
+                }
+                continue;
+            }
+
+            // The window is larger than the server allows: the request is
+            // sent again after a pause, until its deadline
+            if (response.status == RESPONSE_BUSY) {
+                Pending *p = find_pending(session, response.requestId);
+                if (p != NULL && p->sent && p->request.deadline > now_ms()) {
+                    requeue_busy(session, p);
+                    continue;
+                }
+            } else {
+                // A request left the server: the busy ones can be sent again
+                session->retryAt = 0;
+            }
+
+            // Responses of requests already expired here are ignored
+            Pending *p = take_pending(session, response.requestId);
+            if (p != NULL) {
+                p->response = response;
+                p->queued = *done;
+                *done = p;
+            }
+        }
+
+        size_t used = n * sizeof(struct Response);
+        memmove(session->readBuffer, session->readBuffer + used, session->readPending - used);
+        session->readPending -= used;
+    }
+}
+
+// Move the requests whose deadline passed to `done`, called with the mutex
+// locked. Return the nearest deadline of the others, 0 if none. The requests
+// never sent have no deadline yet
+static long long expire_pending(Sha256Session *session, Pending **done) {
+    long long now = now_ms();
+    long long nearest = 0;
+
+    for (int i = 0; i < PENDING_BUCKETS; i++) {
+        Pending *p = session->table[i];
+        while (p != NULL) {
+            Pending *next = p->next;
+            if (p->request.deadline == 0) {
+                // Waiting in the send queue
+            } else if (p->request.deadline <= now) {
+                // Unsent requests leave the send queue too
+                if (!p->sent) {
+                    Pending **link = &session->queueFront;
+                    Pending *last = NULL;
+                    while (*link != p) {
+                        last = *link;
+                        link = &(*link)->queued;
+                    }
+                    *link = p->queued;
+                    if (session->queueRear == p)
+                        session->queueRear = last;
+                }
+                take_pending(session, p->request.requestId);
+                p->response.status = SHA256_TIMEOUT;
+                p->queued = *done;
+                *done = p;
+            } else if (nearest == 0 || p->request.deadline < nearest) {
+                nearest = p->request.deadline;
+            }
+            p = next;
+        }
+    }
+    return nearest;
+}
+
+// Call the callbacks of the completed requests and of the batches of chunks,
+// then free them. Return how many requests completed
+static int dispatch(Sha256Session *session, Pending *done) {
+    int completed = 0;
+    Sha256Result result;
+
+    // `done` was built pushing at the front: the batches of a request are
+    // delivered in the order they were read
+    Pending *ordered = NULL;
+    while (done != NULL) {
+        Pending *next = done->queued;
+        done->queued = ordered;
+        ordered = done;
+        done = next;
+    }
+    done = ordered;
+
+    while (done != NULL) {
+        Pending *next = done->queued;
+
+        result.requestId = done->request.requestId;
+        result.status = done->response.status;
+        strcpy(result.fileName, done->request.fileName);
+        result.more = 0;
+        result.numChunks = 0;
+        if (result.status == SHA256_TIMEOUT) {
+            result.algorithms = 0;
+            strcpy(result.message, "Timeout");
+        } else {
+            result.more = done->response.more;
+            result.numChunks = done->response.numChunks;
+            if (result.numChunks < 0 || result.numChunks > CHUNKS_PER_RESPONSE)
+                result.numChunks = 0;
+            memcpy(result.chunks, done->response.chunks, sizeof(struct ChunkInfo) * result.numChunks);
+            result.algorithms = done->response.algorithms;
+            memcpy(result.message, done->response.hashCode, sizeof(result.message));
+            result.message[sizeof(result.message) - 1] = '\0';
+            memcpy(result.digests, done->response.digests, sizeof(result.digests));
+        }
+
+        if (done->callback != NULL)
+            done->callback(&result, done->userData);
+        slab_free(&session->entries, done);
+        if (!result.more)
+            completed++;
+        done = next;
+    }
+    return completed;
+}
+
+int sha256_poll(Sha256Session *session, int timeoutMs) {
+    long long start = now_ms();
+
+    for (;;) {
+        Pending *done = NULL;
+
+        pthread_mutex_lock(&session->mutex);
+        if (flush_queue(session) != 0) {
+            pthread_mutex_unlock(&session->mutex);
+            return -1;
+        }
+        read_responses(session, &done);
+        long long nearest = expire_pending(session, &done);
+        int pending = session->pending;
+        int blocked = session->queueFront != NULL && session->inflight < session->window;
+        long long retryAt = session->retryAt;
+        pthread_mutex_unlock(&session->mutex);
+
+        // Partial results end the wait too, without counting as completed
+        int called = done != NULL;
+        int completed = dispatch(session, done);
+        if (called || pending == 0)
+            return completed;
+
+        // Wait for a response, the nearest deadline or the end of the timeout,
+        // -1 = no deadline: only unsent requests waiting for the window
+        long long now = now_ms();
+        long long wait = nearest == 0 ? -1 : nearest - now;
+        if (nearest != 0 && wait < 0)
+            wait = 0;
+        if (timeoutMs >= 0) {
+            long long left = start + timeoutMs - now;
+            if (left <= 0)
+                return 0;
+            if (wait == -1 || left < wait)
+                wait = left;
+        }
+        // The server was busy: the queue is not sent before the pause ends
+        if (blocked && retryAt > now) {
+            blocked = 0;
+            if (wait == -1 || retryAt - now < wait)
+                wait = retryAt - now;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = session->clientFIFO;
+        fds[0].events = POLLIN;
+        // The server FIFO was full: wait until requests can be sent again
+        fds[1].fd = session->serverFIFO;
+        fds[1].events = POLLOUT;
+        if (poll(fds, blocked ? 2 : 1, (int)wait) == -1 && errno != EINTR)
+            return -1;
+    }
+}
+
+// Callback of sha256_hash_file
+static void store_result(const Sha256Result *result, void *userData) {
+    *(Sha256Result *)userData = *result;
+}
+
+int sha256_hash_file(Sha256Session *session, const char *path, unsigned int algorithms,
+                     int timeoutMs, Sha256Result *result) {
+    result->requestId = 0;
+    unsigned int requestId = sha256_submit(session, path, algorithms, timeoutMs, store_result, result);
+    if (requestId == 0)
+        return -1;
+
+    // Every request expires, so the loop always ends
+    while (result->requestId != requestId || result->more) {
+        if (sha256_poll(session, -1) == -1)
+            return -1;
+    }
+    return 0;
+}
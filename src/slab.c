@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../inc/slab.h"
+
+#define SLAB_ALIGN 16
+
+// Header of a slab, the objects follow it
+typedef struct Slab {
+    struct Slab *next;
+    char pad[SLAB_ALIGN - sizeof(struct Slab *)];
+} Slab;
+
+// Per-thread free list of a cache
+typedef struct ThreadCache {
+    void *head;
+    int count;
+} ThreadCache;
+
+static __thread ThreadCache threadCaches[MAX_SLAB_CACHES];
+
+// Ids are never reused, so a thread can not find stale objects of a
+// destroyed cache in its free lists
+static int nextCacheId = 0;
+static pthread_mutex_t idMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// A free object stores the pointer to the next one in its first bytes
+#define NEXT(obj) (*(void **)(obj))
+
+void slab_init(SlabCache *cache, size_t obj_size, int objs_per_slab) {
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    cache->obj_size = (obj_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    cache->objs_per_slab = objs_per_slab < SLAB_BATCH ? SLAB_BATCH : objs_per_slab;
+    cache->free_list = NULL;
+    cache->slabs = NULL;
+    pthread_mutex_init(&(cache->mutex), NULL);
+
+    pthread_mutex_lock(&idMutex);
+    cache->id = nextCacheId < MAX_SLAB_CACHES ? nextCacheId++ : -1;
+    pthread_mutex_unlock(&idMutex);
+}
+
+// Add a new slab to the shared free list, called with the mutex locked
+static int slab_grow(SlabCache *cache) {
+    Slab *slab = malloc(sizeof(Slab) + cache->obj_size * cache->objs_per_slab);
+    if (slab == NULL) {
+        perror("Error during slab allocation");
+        return -1;
+    }
+    slab->next = cache->slabs;
+    cache->slabs = slab;
+
+    char *obj = (char *)(slab + 1);
+    for (int i = 0; i < cache->objs_per_slab; i++) {
+        NEXT(obj) = cache->free_list;
+        cache->free_list = obj;
+        obj += cache->obj_size;
+    }
+    return 0;
+}
+
+void *slab_alloc(SlabCache *cache) {
+    void *obj;
+
+    // Shared free list only
+    if (cache->id == -1) {
+        pthread_mutex_lock(&(cache->mutex));
+        if (cache->free_list == NULL && slab_grow(cache) != 0) {
+            pthread_mutex_unlock(&(cache->mutex));
+            return NULL;
+        }
+        obj = cache->free_list;
+        cache->free_list = NEXT(obj);
+        pthread_mutex_unlock(&(cache->mutex));
+        return obj;
+    }
+
+    ThreadCache *tc = &threadCaches[cache->id];
+    if (tc->head == NULL) {
+        // Refill the thread free list with a batch of objects
+        pthread_mutex_lock(&(cache->mutex));
+        for (int i = 0; i < SLAB_BATCH; i++) {
+            if (cache->free_list == NULL && slab_grow(cache) != 0)
+                break;
+            obj = cache->free_list;
+            cache->free_list = NEXT(obj);
+            NEXT(obj) = tc->head;
+            tc->head = obj;
+            tc->count++;
+        }
+        pthread_mutex_unlock(&(cache->mutex));
+        if (tc->head == NULL)
+            return NULL;
+    }
+
+    obj = tc->head;
+    tc->head = NEXT(obj);
+    tc->count--;
+    return obj;
+}
+
+void slab_free(SlabCache *cache, void *obj) {
+    if (obj == NULL)
+        return;
+
+    if (cache->id == -1) {
+        pthread_mutex_lock(&(cache->mutex));
+        NEXT(obj) = cache->free_list;
+        cache->free_list = obj;
+        pthread_mutex_unlock(&(cache->mutex));
+        return;
+    }
+
+    ThreadCache *tc = &threadCaches[cache->id];
+    NEXT(obj) = tc->head;
+    tc->head = obj;
+    tc->count++;
+
+    // Objects often die on another thread than the one that allocated them:
+    // give a batch back so that the allocating thread can reuse it
+    if (tc->count >= 2 * SLAB_BATCH) {
+        pthread_mutex_lock(&(cache->mutex));
+        for (int i = 0; i < SLAB_BATCH; i++) {
+            obj = tc->head;
+            tc->head = NEXT(obj);
+            NEXT(obj) = cache->free_list;
+            cache->free_list = obj;
+        }
+        tc->count -= SLAB_BATCH;
+        pthread_mutex_unlock(&(cache->mutex));
+    }
+}
+
+void slab_destroy(SlabCache *cache) {
+    Slab *slab = cache->slabs;
+    while (slab != NULL) {
+        Slab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    cache->slabs = NULL;
+    cache->free_list = NULL;
+    pthread_mutex_destroy(&(cache->mutex));
+}
@@ -1,11 +1,24 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
+#include <sched.h>
 
 #include "../inc/threadPool.h"
 #include "../inc/requestResponse.h"
+#include "../inc/slab.h"
+
+#define QUEUE_NODES_PER_SLAB 256
+
+// Job nodes of all the pools, recycled instead of malloc/free on each job
+static SlabCache queueNodeCache;
+static pthread_once_t queueNodeCacheOnce = PTHREAD_ONCE_INIT;
+
+static void queue_node_cache_init(void) {
+    slab_init(&queueNodeCache, sizeof(job), QUEUE_NODES_PER_SLAB);
+}
 
 /* Init Binary Semaphore */
 void bsem_init(bsem *b, int v) {
@@ -24,6 +37,14 @@ void bsem_wait(bsem *b) {
     pthread_mutex_unlock(&(b->mutex));
 }
 
+/* Signal there are n available jobs waking up all the sleeping threads */
+void bsem_post_n(bsem *b, int n) {
+    pthread_mutex_lock(&(b->mutex));
+    b->v += n;
+    pthread_cond_broadcast(&(b->cond));
+    pthread_mutex_unlock(&(b->mutex));
+}
+
 /* Signal there is a available job */
 void bsem_post(bsem *b) {
     pthread_mutex_lock(&(b->mutex));
@@ -33,11 +54,13 @@ void bsem_post(bsem *b) {
 }
 
 /* Init Job Queue */
-static void jobqueue_init(jobqueue *jobqueue) {
+static void jobqueue_init(jobqueue *jobqueue, int capacity) {
     jobqueue->len = 0;
+    jobqueue->capacity = capacity;
     jobqueue->front = NULL;
     jobqueue->rear = NULL;
     pthread_mutex_init(&(jobqueue->rwmutex), NULL); // initialize mutex for read/write access to the queue
+    pthread_cond_init(&(jobqueue->has_space), NULL);
     jobqueue->has_jobs = (bsem*)malloc(sizeof(bsem)); // allocate memory for bsem
     if (jobqueue->has_jobs == NULL) {
         perror("Error during allocation bsem");
@@ -51,13 +74,49 @@ static void jobqueue_destroy(jobqueue *jobqueue) {
     job* curr_job = jobqueue->front;
     while(curr_job != NULL) {
         job* next_job = curr_job->prev;
-        free(curr_job); // free the block allocated by malloc
+        slab_free(&queueNodeCache, curr_job); // give the node back to its cache
         curr_job = next_job;
     }
     pthread_mutex_destroy(&(jobqueue->rwmutex));
+    pthread_cond_destroy(&(jobqueue->has_space));
     free(jobqueue->has_jobs);
 }
 
+/* Insert a job keeping the queue sorted by priority, called with rwmutex locked */
+static void jobqueue_insert(jobqueue *jobqueue, job *new_job) {
+    // Inserimento ordinato: cerca la posizione corretta. A job goes after the
+    // jobs of equal priority, so ties are served first-in-first-out
+    job* current = jobqueue->front;
+    job* previous = NULL;
+
+    // Common case of stages with a single priority: append at the rear
+    if (jobqueue->rear != NULL && jobqueue->rear->priority <= new_job->priority) {
+        previous = jobqueue->rear;
+        current = NULL;
+    }
+
+    while (current != NULL && current->priority <= new_job->priority) {
+        previous = current;
+        current = current->prev;
+    }
+
+    if (previous == NULL) {
+        // Inserimento in testa
+        new_job->prev = jobqueue->front;
+        jobqueue->front = new_job;
+    } else {
+        // Inserimento nel mezzo o in coda
+        new_job->prev = current;
+        previous->prev = new_job;
+    }
+
+    if (current == NULL) {
+        jobqueue->rear = new_job;
+    }
+
+    jobqueue->len++;
+}
+
 /* Extract a job from the queue */
 static job* jobqueue_pull(jobqueue *jobqueue) {
     pthread_mutex_lock(&(jobqueue->rwmutex)); // get the mutex for read/write operations on jobqueue
@@ -77,6 +136,11 @@ static job* jobqueue_pull(jobqueue *jobqueue) {
         jobqueue->rear = NULL;
     }
 
+    // Wake up a producer blocked on a full bounded queue
+    if (jobqueue->capacity > 0) {
+        pthread_cond_signal(&(jobqueue->has_space));
+    }
+
     pthread_mutex_unlock(&(jobqueue->rwmutex));
     return job;
 }
@@ -105,7 +169,7 @@ void *worker_thread(void *arg) {
 
         if (current_job) {
             current_job->function(current_job->arg); // execute the thread function
-            free(current_job);
+            slab_free(&queueNodeCache, current_job);
         }
 
         // update count vars and get up any waiting threads
@@ -132,6 +196,18 @@ void *worker_thread(void *arg) {
 
 // Init Thread Pool
 void threadpool_init(ThreadPool *pool, int num_threads) {
+    threadpool_init_bounded(pool, num_threads, 0);
+}
+
+// Init Thread Pool whose queue holds at most `capacity` jobs (0 = unbounded).
+// When the queue is full threadpool_add_job blocks the producer (backpressure).
+void threadpool_init_bounded(ThreadPool *pool, int num_threads, int capacity) {
+    threadpool_init_pinned(pool, num_threads, capacity, NULL, 0);
+}
+
+// Init Thread Pool pinning the i-th worker to cpus[i % num_cpus].
+// With num_cpus == 0 the workers are free to run on any CPU.
+void threadpool_init_pinned(ThreadPool *pool, int num_threads, int capacity, const int *cpus, int num_cpus) {
     if (num_threads < 1) {
         num_threads = 1;
     }
@@ -143,11 +219,13 @@ void threadpool_init(ThreadPool *pool, int num_threads) {
         exit(1);
     }
 
+    pthread_once(&queueNodeCacheOnce, queue_node_cache_init);
+
     pool->num_threads = num_threads;
     pool->num_threads_alive = 0;
     pool->num_threads_working = 0;
 
-    jobqueue_init(&(pool->jobqueue));
+    jobqueue_init(&(pool->jobqueue), capacity);
     pthread_mutex_init(&(pool->thcount_lock), NULL);
     pthread_cond_init(&(pool->threads_all_idle), NULL);
 
@@ -160,56 +238,108 @@ void threadpool_init(ThreadPool *pool, int num_threads) {
         }
         pool->threads[i]->thpool_p = pool;
         pool->threads[i]->id = i;
-        pthread_create(&(pool->threads[i]->pthread), NULL, worker_thread, pool->threads[i]);
+        pool->threads[i]->cpu = num_cpus > 0 ? cpus[i % num_cpus] : -1;
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (pool->threads[i]->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(pool->threads[i]->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+        }
+        if (pthread_create(&(pool->threads[i]->pthread), &attr, worker_thread, pool->threads[i]) != 0) {
+            // The CPU may be outside the allowed set: run the worker unpinned
+            fprintf(stderr, "Cannot pin thread %d to CPU %d\n", i, pool->threads[i]->cpu);
+            pool->threads[i]->cpu = -1;
+            if (pthread_create(&(pool->threads[i]->pthread), NULL, worker_thread, pool->threads[i]) != 0) {
+                perror("Error during thread creation");
+                exit(1);
+            }
+        }
+        pthread_attr_destroy(&attr);
     }
 }
 
-// Add a job to thread pool
+// Add a job to thread pool, ordered by the file size of the request
 void threadpool_add_job(ThreadPool *pool, void (*function)(void*), void* arg) {
-    job* new_job = (job*)malloc(sizeof(job));
+    // Recupera la dimensione del file dalla richiesta
+    struct Request* request = (struct Request*)arg;
+    threadpool_add_job_priority(pool, function, arg, request->fileSize);
+}
+
+// Insert a job in the queue sorted by priority. If the bounded queue is full
+// wait for a free slot when `block` is set, otherwise give up and return -1
+static int threadpool_push(ThreadPool *pool, void (*function)(void*), void* arg, long long priority, int block) {
+    job* new_job = (job*)slab_alloc(&queueNodeCache);
     if (new_job == NULL) {
         perror("Error during job allocation");
-        return;
+        return -1;
     }
 
-    // Recupera la dimensione del file dalla richiesta
-    struct Request* request = (struct Request*)arg;
     new_job->function = function;
     new_job->arg = arg;
-    new_job->priority = request->fileSize;
+    new_job->priority = priority;
     new_job->prev = NULL;
 
     pthread_mutex_lock(&(pool->jobqueue.rwmutex));
 
-    // Inserimento ordinato: cerca la posizione corretta
-    job* current = pool->jobqueue.front;
-    job* previous = NULL;
-
-    while (current != NULL && current->priority < new_job->priority) {
-        previous = current;
-        current = current->prev;
-    }
-
-    if (previous == NULL) {
-        // Inserimento in testa
-        new_job->prev = pool->jobqueue.front;
-        pool->jobqueue.front = new_job;
-    } else {
-        // Inserimento nel mezzo o in coda
-        new_job->prev = current;
-        previous->prev = new_job;
-    }
-
-    if (current == NULL) {
-        pool->jobqueue.rear = new_job;
+    // Bounded queue: wait until a worker pulls a job
+    while (pool->jobqueue.capacity > 0 && pool->jobqueue.len >= pool->jobqueue.capacity) {
+        if (!block) {
+            pthread_mutex_unlock(&(pool->jobqueue.rwmutex));
+            slab_free(&queueNodeCache, new_job);
+            return -1;
+        }
+        pthread_cond_wait(&(pool->jobqueue.has_space), &(pool->jobqueue.rwmutex));
     }
 
-    pool->jobqueue.len++;
+    jobqueue_insert(&(pool->jobqueue), new_job);
 
     pthread_mutex_unlock(&(pool->jobqueue.rwmutex));
 
     // Signal there is an available job
     bsem_post(pool->jobqueue.has_jobs);
+    return 0;
+}
+
+// Add a job to thread pool with an explicit priority (lower values run first)
+void threadpool_add_job_priority(ThreadPool *pool, void (*function)(void*), void* arg, long long priority) {
+    threadpool_push(pool, function, arg, priority, 1);
+}
+
+// Add a job only if the queue has room: return 0 on success, -1 if it is full
+int threadpool_try_add_job_priority(ThreadPool *pool, void (*function)(void*), void* arg, long long priority) {
+    return threadpool_push(pool, function, arg, priority, 0);
+}
+
+// Add up to n jobs taking the queue lock once and waking the workers once.
+// Jobs that do not fit a bounded queue are left out: return how many of the
+// first jobs were added
+int threadpool_try_add_jobs(ThreadPool *pool, void (*function)(void*), void** args, const long long* priorities, int n) {
+    int added = 0;
+
+    pthread_mutex_lock(&(pool->jobqueue.rwmutex));
+    while (added < n &&
+           (pool->jobqueue.capacity == 0 || pool->jobqueue.len < pool->jobqueue.capacity)) {
+        job* new_job = (job*)slab_alloc(&queueNodeCache);
+        if (new_job == NULL) {
+            perror("Error during job allocation");
+            break;
+        }
+        new_job->function = function;
+        new_job->arg = args[added];
+        new_job->priority = priorities[added];
+        new_job->prev = NULL;
+        jobqueue_insert(&(pool->jobqueue), new_job);
+        added++;
+    }
+    pthread_mutex_unlock(&(pool->jobqueue.rwmutex));
+
+    if (added > 0) {
+        bsem_post_n(pool->jobqueue.has_jobs, added);
+    }
+    return added;
 }
 
 // Block the calling thread until all the jobs are completed